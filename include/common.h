@@ -14,6 +14,8 @@
 #include "os-mm.h"
 #endif
 
+#include "rbtree.h"
+
 #define ADDRESS_SIZE 20
 #define OFFSET_LEN 10
 #define FIRST_LV_LEN 5
@@ -73,6 +75,15 @@ struct page_table_t
 	int size; // Number of row in the first layer
 };
 
+/* Process states, see sched.c */
+enum proc_state
+{
+	PROC_READY,   // In a ready queue
+	PROC_RUNNING, // Dispatched on a CPU
+	PROC_BLOCKED, // On a wait queue or sleeping for some time slots
+	PROC_ZOMBIE,  // Finished, not freed yet
+};
+
 /* PCB, describe information about a process */
 struct pcb_t
 {
@@ -80,8 +91,18 @@ struct pcb_t
 	uint32_t priority;	 // Default priority, this legacy process based (FIXED)
 	char path[100];
 	struct code_seg_t *code; // Code segment
-	addr_t regs[10];	 // Registers, store address of allocated regions
+	addr_t *regs;		 // Registers, store address of allocated regions
+	uint32_t nregs;		 // Number of registers, grown on demand
 	uint32_t pc;		 // Program pointer, point to the next instruction
+	uint32_t cpu;		 // CPU the process was last dispatched on
+	uint32_t affinity;	 // Mask of the CPUs it may run on
+	uint32_t mig_stall;	 // Slots left to refill a cold cache
+	enum proc_state state;
+	int on_cpu;		 // A CPU still runs its current instruction
+	uint64_t wake_time;	 // End of a timed block, 0 on a wait queue
+	struct queue_t *wait_q;	 // Wait queue it is blocked on
+	int killed;		 // Torn down by its CPU instead of running on
+	uint32_t io_slots;	 // Device time its last instruction waits for
 	struct queue_t *ready_queue;
 	struct queue_t *running_list;
 #ifdef MLQ_SCHED
@@ -89,6 +110,8 @@ struct pcb_t
 	// Priority on execution (if supported), on-fly aka. changeable
 	// and this vale overwrites the default priority when it existed
 	uint32_t prio;
+	uint32_t base_prio;	 // prio at load, aging moves prio above it
+	uint64_t aged_since;	 // Start of the current aging step
 #endif
 #ifdef MM_PAGING
 	struct mm_struct *mm;
@@ -99,6 +122,28 @@ struct pcb_t
 #endif
 	struct page_table_t *page_table; // Page table
 	uint32_t bp;			 // Break pointer
+
+	/* CFS state, see sched.c */
+	struct rb_node sched_node;	 // Link in the vruntime timeline
+	uint64_t vruntime;		 // Run time scaled by NICE_0_WEIGHT / weight
+	uint32_t weight;		 // Load weight of the priority
+
+	/* Deadline class, dl_deadline is 0 outside of it */
+	uint32_t dl_deadline;		 // Relative deadline, slots after arrival
+	uint32_t dl_budget;		 // CPU slots the process asks for
+	uint64_t dl_abs;		 // Absolute deadline, the EDF key
+	int dl_admitted;		 // Passed admission and still within budget
+
+	/* Scheduling accounting, in time slots */
+	uint64_t arrival_time;
+	uint64_t first_run;
+	uint64_t ready_since;		 // Last time put in the ready queue or blocked
+	uint64_t blocked_time;		 // Total time blocked
+	uint64_t exec_start;		 // Last dispatch
+	uint64_t wait_time;		 // Total time ready but not running
+	uint64_t run_time;
+	uint32_t nr_dispatch;
+	uint32_t nr_migrations;		 // Dispatches on another CPU than the last
 };
 
 #endif
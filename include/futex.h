@@ -0,0 +1,17 @@
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include "common.h"
+
+/* Waits on a byte of a private page are keyed by its mm and virtual
+ * address, on a shared page by its MEMRAM address, so processes that
+ * attached the same segment meet on the same key */
+struct futex_key {
+	void * mm;		/* NULL for a shared page */
+	unsigned long addr;
+};
+
+/* Waits, wakeups and waits that found the value changed */
+void print_futex_stat(void);
+
+#endif
@@ -9,8 +9,9 @@
  */
 
 #include "common.h"
+#include <pthread.h>
 
-#define SYSMEM_MAP_OP 1   // sử dụng trình xử lý giả lập (dummy handler)
+#define SYSMEM_MAP_OP 1   // ánh xạ vùng nhớ chia sẻ với hàm shm_attach()
 #define SYSMEM_INC_OP 2   // tăng giới hạn bộ nhớ với hàm inc_vma_limit()
 #define SYSMEM_SWP_OP 3   // hoán đổi trang bộ nhớ với hàm mm_swap_page()
 #define SYSMEM_IO_READ 4  // đọc bộ nhớ vật lý với hàm MEMPHY_read()
@@ -23,4 +24,8 @@ int liballoc(struct pcb_t *, uint32_t, uint32_t);
 int libfree(struct pcb_t *, uint32_t);
 int libread(struct pcb_t *, uint32_t, uint32_t, uint32_t *);
 int libwrite(struct pcb_t *, BYTE, uint32_t, uint32_t);
-int free_pcb_memph(struct pcb_t *);
\ No newline at end of file
+int pg_getval(struct mm_struct *, int, BYTE *, struct pcb_t *);
+int free_pcb_memph(struct pcb_t *);
+
+/* Serializes every operation on the mm structures and MEMPHY devices */
+extern pthread_mutex_t mmvm_lock;
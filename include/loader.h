@@ -5,5 +5,11 @@
 
 struct pcb_t * load(const char * path);
 
+/* Free a PCB and its code segment, the address space goes first */
+void free_pcb(struct pcb_t * proc);
+
+/* Get a new unique process ID */
+uint32_t alloc_pid(void);
+
 #endif
 
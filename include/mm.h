@@ -2,6 +2,7 @@
 
 #include "bitops.h"
 #include "common.h"
+#include <pthread.h>
 
 /* Value operators */
 #define SETBIT(v, mask) (v = v | mask)
@@ -12,13 +13,25 @@
 
 /* CPU Bus definition */
 #define PAGING_CPU_BUS_WIDTH 22 /* 22bit bus - MAX SPACE 4MB */
-#define PAGING_PAGESZ 256       /* 256B or 8-bits PAGE NUMBER */
+#define PAGING_PGSHIFT_MIN 8    /* 256B pages */
+#define PAGING_PGSHIFT_MAX 16   /* 64KB pages */
+
+/* Page size is selected per run (PAGESZ config key) through
+ * paging_set_pagesz(). Building with -DPAGING_FIXED_PGSHIFT=<n> pins it
+ * instead, so every translation below folds to constant shifts/masks.
+ */
+#ifdef PAGING_FIXED_PGSHIFT
+#define paging_pgshift PAGING_FIXED_PGSHIFT
+#else
+extern unsigned int paging_pgshift;
+#endif
+#define PAGING_PAGESZ (1 << paging_pgshift)
 #define PAGING_MEMRAMSZ BIT(21)
 #define PAGING_PAGE_ALIGNSZ(sz) (DIV_ROUND_UP(sz, PAGING_PAGESZ) * PAGING_PAGESZ)
 
 #define PAGING_MEMSWPSZ BIT(29)
 #define PAGING_SWPFPN_OFFSET 5
-#define PAGING_MAX_PGN (DIV_ROUND_UP(BIT(PAGING_CPU_BUS_WIDTH), PAGING_PAGESZ))
+#define PAGING_MAX_PGN (1 << (PAGING_CPU_BUS_WIDTH - paging_pgshift))
 
 #define PAGING_SBRK_INIT_SZ PAGING_PAGESZ
 /* PTE BIT */
@@ -29,9 +42,21 @@
 #define PAGING_PTE_EMPTY01_MASK BIT(14)
 #define PAGING_PTE_EMPTY02_MASK BIT(13)
 
+/* Present page of a shared memory segment, mapped writable by every
+ * attached mm and never swapped out */
+#define PAGING_PTE_SHARED_MASK PAGING_PTE_EMPTY02_MASK
+
+/* Present page shared read-only with another mm, copied on first write.
+ * It reuses a spare bit that belongs to the swap offset once swapped. */
+#define PAGING_PTE_COW_MASK PAGING_PTE_EMPTY01_MASK
+
+/* Present page brought in by swap readahead, not accessed since */
+#define PAGING_PTE_READAHEAD_MASK PAGING_PTE_RESERVE_MASK
+
 /* PTE BIT PRESENT */
 #define PAGING_PTE_SET_PRESENT(pte) (pte = pte | PAGING_PTE_PRESENT_MASK)
 #define PAGING_PAGE_PRESENT(pte) (pte & PAGING_PTE_PRESENT_MASK)
+#define PAGING_PAGE_SWAPPED(pte) (pte & PAGING_PTE_SWAPPED_MASK)
 
 /* USRNUM */
 #define PAGING_PTE_USRNUM_LOBIT 15
@@ -46,6 +71,9 @@
 #define PAGING_PTE_SWPOFF_LOBIT 5
 #define PAGING_PTE_SWPOFF_HIBIT 25
 
+/* Swap type of pages held by the compressed pool, see mm-zswap.c */
+#define PAGING_SWPTYP_ZSWAP 31
+
 /* PTE */
 #define PAGING_PTE_USRNUM_MASK GENMASK(PAGING_PTE_USRNUM_HIBIT, PAGING_PTE_USRNUM_LOBIT)
 #define PAGING_PTE_FPN_MASK GENMASK(PAGING_PTE_FPN_HIBIT, PAGING_PTE_FPN_LOBIT)
@@ -60,18 +88,18 @@
 
 /* OFFSET */
 #define PAGING_ADDR_OFFST_LOBIT 0
-#define PAGING_ADDR_OFFST_HIBIT (NBITS(PAGING_PAGESZ) - 1)
+#define PAGING_ADDR_OFFST_HIBIT (paging_pgshift - 1)
 
 /* PAGE Num */
-#define PAGING_ADDR_PGN_LOBIT NBITS(PAGING_PAGESZ)
+#define PAGING_ADDR_PGN_LOBIT paging_pgshift
 #define PAGING_ADDR_PGN_HIBIT (PAGING_CPU_BUS_WIDTH - 1)
 
 /* Frame PHY Num */
-#define PAGING_ADDR_FPN_LOBIT NBITS(PAGING_PAGESZ)
+#define PAGING_ADDR_FPN_LOBIT paging_pgshift
 #define PAGING_ADDR_FPN_HIBIT (NBITS(PAGING_MEMRAMSZ) - 1)
 
 /* SWAPFPN */
-#define PAGING_SWP_LOBIT NBITS(PAGING_PAGESZ)
+#define PAGING_SWP_LOBIT paging_pgshift
 #define PAGING_SWP_HIBIT (NBITS(PAGING_MEMSWPSZ) - 1)
 #define PAGING_SWP(pte) ((pte & PAGING_PTE_SWPOFF_MASK) >> PAGING_SWPFPN_OFFSET)
 
@@ -88,37 +116,96 @@
 #define PAGING_FPN_MASK GENMASK(PAGING_ADDR_FPN_HIBIT, PAGING_ADDR_FPN_LOBIT)
 #define PAGING_SWP_MASK GENMASK(PAGING_SWP_HIBIT, PAGING_SWP_LOBIT)
 
+/* Address translation, one shift or mask each */
+static inline uint32_t paging_offst(uint32_t addr)
+{
+  return addr & ((1U << paging_pgshift) - 1);
+}
+
+static inline uint32_t paging_pgn(uint32_t addr)
+{
+  return (addr >> paging_pgshift) &
+         ((1U << (PAGING_CPU_BUS_WIDTH - paging_pgshift)) - 1);
+}
+
+static inline uint32_t paging_phyaddr(uint32_t fpn, uint32_t offst)
+{
+  return (fpn << paging_pgshift) + offst;
+}
+
 /* Extract OFFSET */
-// #define PAGING_OFFST(x)  ((x&PAGING_OFFST_MASK) >> PAGING_ADDR_OFFST_LOBIT)
-#define PAGING_OFFST(x) GETVAL(x, PAGING_OFFST_MASK, PAGING_ADDR_OFFST_LOBIT)
+#define PAGING_OFFST(x) paging_offst(x)
 /* Extract Page Number*/
-#define PAGING_PGN(x) GETVAL(x, PAGING_PGN_MASK, PAGING_ADDR_PGN_LOBIT)
+#define PAGING_PGN(x) paging_pgn(x)
 /* Extract FramePHY Number*/
 #define PAGING_FPN(x) GETVAL(x, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT)
 /* Extract SWAPFPN */
-// #define PAGING_PGN(x) GETVAL(x, PAGING_PGN_MASK, PAGING_ADDR_PGN_LOBIT)
 #define PAGING_SWPFPN(x) GETVAL(x, PAGING_PTE_SWPOFF_MASK, PAGING_SWPFPN_OFFSET)
 /* Extract SWAPTYPE */
-// #define PAGING_FPN(x) GETVAL(x, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT)
 #define PAGING_SWPTYP(x) GETVAL(x, PAGING_PTE_SWPTYP_MASK, PAGING_PTE_SWPTYP_LOBIT)
 /* Extract PHY address */
-#define PAGING_PHYADDR(fpn, offst) (((fpn) << PAGING_ADDR_FPN_LOBIT) + (offst))
+#define PAGING_PHYADDR(fpn, offst) paging_phyaddr(fpn, offst)
+
+/* Frames addressable by the PTE FPN field */
+#define PAGING_MAX_FPN BIT(PAGING_PTE_FPN_HIBIT - PAGING_PTE_FPN_LOBIT + 1)
+
+/* Memory range operator on half-open ranges [x1, x2) and [y1, y2) */
+#define INCLUDE(x1, x2, y1, y2) ((x1) >= (y1) && (x2) <= (y2))
+#define OVERLAP(x1, x2, y1, y2) ((x1) < (y2) && (y1) < (x2))
+
+/* VM area flags */
+#define VM_SHARED BIT(0)
 
-/* Memory range operator */
-/* TODO implement the INCLUDE and OVERLAP checking mechanism */
-#define INCLUDE(x1, x2, y1, y2) (0)
-#define OVERLAP(x1, x2, y1, y2) (0)
+/* Frame descriptor flags */
+#define FRAME_REFERENCED BIT(0) /* accessed since the clock hand passed */
+#define FRAME_MERGED BIT(1)     /* shared by ksm, see mm-ksm.c */
+
+/* Top of the virtual address space */
+#define PAGING_VMA_LIMIT ((unsigned long)PAGING_MAX_PGN * PAGING_PAGESZ)
+
+/* Paging activity counters */
+struct mm_stat_struct
+{
+  unsigned long pgfault;      /* accesses to a page not in MEMRAM */
+  unsigned long pgfault_zero; /* first touches served with a zero frame */
+  unsigned long pgswapin;     /* pages copied from MEMSWP to MEMRAM */
+  unsigned long pgswapout;    /* pages copied from MEMRAM to MEMSWP */
+  unsigned long cow_fault;    /* writes to a copy-on-write page */
+  unsigned long cow_copy;     /* ... that had to duplicate the frame */
+  unsigned long pgsteal_kswapd; /* frames freed ahead of need by kswapd */
+  unsigned long pgsteal_direct; /* frames freed by evicting in a fault */
+  unsigned long pgsteal_foreign; /* ... taken from another process */
+  unsigned long pgswapout_clean; /* evictions of a clean swap cache page */
+  unsigned long swpslot_freed;  /* slots released on swap-in */
+  unsigned long ra_pages;     /* pages swapped in by readahead */
+  unsigned long ra_hits;      /* ... and accessed before eviction */
+};
+
+extern struct mm_stat_struct mm_stat;
+
+/* Live address spaces, linked by mm_next */
+extern struct mm_struct *mm_list;
+extern pthread_mutex_t mm_list_lock;
 
 /* VM region prototypes */
 struct vm_rg_struct *init_vm_rg(int rg_start, int rg_endi);
 int enlist_vm_rg_node(struct vm_rg_struct **rglist, struct vm_rg_struct *rgnode);
 int enlist_pgn_node(struct pgn_t **pgnlist, int pgn);
+int delist_pgn_node(struct pgn_t **pgnlist, int pgn);
 int vmap_page_range(struct pcb_t *caller, int addr, int pgnum,
                     struct framephy_struct *frames, struct vm_rg_struct *ret_rg);
 int vm_map_ram(struct pcb_t *caller, int astart, int send, int mapstart, int incpgnum, struct vm_rg_struct *ret_rg);
 int alloc_pages_range(struct pcb_t *caller, int incpgnum, struct framephy_struct **frm_lst);
 int __swap_cp_page(struct memphy_struct *mpsrc, int srcfpn,
                    struct memphy_struct *mpdst, int dstfpn);
+int __zero_fill_page(struct memphy_struct *mp, int fpn);
+int swap_out_pgn(struct mm_struct *mm, int vicpgn, struct memphy_struct *mram,
+                 struct memphy_struct *mswp, int *retfpn);
+int swap_out_page(struct mm_struct *mm, struct memphy_struct *mram,
+                  struct memphy_struct *mswp, int *retfpn);
+int swap_out_victim(struct pcb_t *caller, int *retfpn);
+int get_free_frame(struct pcb_t *caller, int *retfpn);
+int swap_in_page(struct pcb_t *caller, int pgn, int fpn);
 int pte_set_fpn(uint32_t *pte, int fpn);
 int pte_set_swap(uint32_t *pte, int swptyp, int swpoff);
 int init_pte(uint32_t *pte,
@@ -132,7 +219,19 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, int size, int *alloc_addr
 int __free(struct pcb_t *caller, int vmaid, int rgid);
 int __read(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE *data);
 int __write(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE value);
+int paging_set_pagesz(unsigned int pgsz);
+int paging_set_demand(int on);
+int paging_get_demand(void);
 int init_mm(struct mm_struct *mm, struct pcb_t *caller);
+int mm_register(struct mm_struct *mm);
+int mm_unregister(struct mm_struct *mm);
+int mm_is_registered(struct mm_struct *mm);
+int exit_mm(struct mm_struct *mm, struct pcb_t *caller);
+int print_mm_leaks(struct memphy_struct *mram, struct memphy_struct *mswp);
+int dup_mm(struct mm_struct *dst, struct pcb_t *caller);
+int do_cow_page(struct pcb_t *caller, int pgn, int *retfpn);
+void __cow_last_mapping(struct memphy_struct *mram, int fpn);
+int enlist_vm_freerg_list(struct vm_area_struct *vma, struct vm_rg_struct *rg_elmt);
 
 /* VM prototypes */
 int pgalloc(struct pcb_t *proc, uint32_t size, uint32_t reg_index);
@@ -149,15 +248,39 @@ int pgwrite(
     uint32_t offset);
 /* Local VM prototypes */
 struct vm_rg_struct *get_symrg_byid(struct mm_struct *mm, int rgid);
+struct vm_rg_struct *get_symrg_slot(struct mm_struct *mm, int rgid);
 int validate_overlap_vm_area(struct pcb_t *caller, int vmaid, int vmastart, int vmaend);
 int get_free_vmrg_area(struct pcb_t *caller, int vmaid, int size, struct vm_rg_struct *newrg);
 int inc_vma_limit(struct pcb_t *caller, int vmaid, int inc_sz);
-int find_victim_page(struct mm_struct *mm, int *pgn);
+int find_victim_page(struct mm_struct *mm, struct memphy_struct *mram, int *pgn);
 struct vm_area_struct *get_vma_by_num(struct mm_struct *mm, int vmaid);
+struct vm_area_struct *find_vma(struct mm_struct *mm, unsigned long addr);
+int insert_vm_area(struct mm_struct *mm, struct vm_area_struct *vma);
+int remove_vm_area(struct mm_struct *mm, struct vm_area_struct *vma);
+long get_unmapped_area(struct mm_struct *mm, unsigned long len);
+
+/* Shared memory prototypes */
+int shm_get(struct pcb_t *caller, int key, int size);
+int shm_nframes(void);
+int shm_attach(struct pcb_t *caller, int key, unsigned long *addr);
+int shm_detach(struct memphy_struct *mram, struct mm_struct *mm, struct vm_area_struct *vma);
+int shm_dup(struct mm_struct *mm, struct vm_area_struct *vma);
 
 /* MEM/PHY protypes */
 int MEMPHY_get_freefp(struct memphy_struct *mp, int *fpn);
 int MEMPHY_put_freefp(struct memphy_struct *mp, int fpn);
+int MEMPHY_get_freefp_range(struct memphy_struct *mp, int num, int *retfpn);
+int MEMPHY_get_freefp_node(struct memphy_struct *mp, int nid, int *retfpn);
+int MEMPHY_set_nodes(struct memphy_struct *mp, int nnodes);
+int MEMPHY_set_swpcache(struct memphy_struct *mp, int fpn,
+                        struct memphy_struct *swpdev, int swptyp, int swpoff);
+int MEMPHY_take_swpcache(struct memphy_struct *mp, int fpn, int *swptyp, int *swpoff);
+int MEMPHY_drop_swpcache(struct memphy_struct *mp, int fpn);
+int MEMPHY_set_owner(struct memphy_struct *mp, int fpn, struct mm_struct *mm, int pgn);
+int MEMPHY_clear_owner(struct memphy_struct *mp, int fpn);
+int MEMPHY_ref_frame(struct memphy_struct *mp, int fpn);
+int MEMPHY_unref_frame(struct memphy_struct *mp, int fpn);
+int MEMPHY_frame_refcnt(struct memphy_struct *mp, int fpn);
 int MEMPHY_read(struct memphy_struct *mp, int addr, BYTE *value);
 int MEMPHY_write(struct memphy_struct *mp, int addr, BYTE data);
 int MEMPHY_dump(struct memphy_struct *mp);
@@ -170,4 +293,56 @@ int print_list_vma(struct vm_area_struct *rg);
 
 int print_list_pgn(struct pgn_t *ip);
 int print_pgtbl(struct pcb_t *ip, uint32_t start, uint32_t end);
+int print_mm_stat(void);
+
+/* Swap device manager */
+int swap_set_prio(int swptyp, int prio);
+int swap_set_cluster(int npages);
+int swap_get_cluster(void);
+int swap_set_latency(int slots);
+void swap_io_charge(struct pcb_t *caller, unsigned long npages);
+int swap_get_latency(void);
+int swap_get_slot(struct memphy_struct *mswp, int *swptyp, int *swpoff);
+int swap_get_cluster_slot(struct mm_struct *mm, struct memphy_struct *mswp,
+                          int *swptyp, int *swpoff);
+int swapin_readahead(struct pcb_t *caller, int pgn);
+int print_swap_stat(struct memphy_struct *mswp);
+
+/* Asynchronous swap I/O, queues of at most SWAPIO_QDEPTH_MAX pages */
+#define SWAPIO_QDEPTH_MAX 64
+int swapio_init(struct memphy_struct *mswp, int depth);
+int swapio_write(struct memphy_struct *mram, int fpn, struct memphy_struct *mswp,
+                 int swptyp, int swpoff);
+int swapio_read(int swptyp, int swpoff, struct memphy_struct *mram, int fpn);
+int swapio_service(void);
+int swapio_drain(void);
+int print_swapio_stat(void);
+
+/* Page reclaim */
+int vmscan_set_global(int global);
+int reclaim_global(struct memphy_struct *mram, struct memphy_struct *mswp,
+                   struct mm_struct **retmm, int *retfpn);
+int kswapd_balance(struct memphy_struct *mram, struct memphy_struct *mswp,
+                   int wmark_low, int wmark_high);
+
+/* Compressed swap pool */
+int zswap_init(unsigned long poolsz);
+int zswap_store(struct memphy_struct *mram, int fpn, int *handle);
+int zswap_load(int handle, struct memphy_struct *mram, int fpn);
+int zswap_ref(int handle);
+int zswap_put(int handle);
+int zswap_nentries(void);
+int print_zswap_stat(void);
+
+/* Same page merging */
+int ksm_scan(struct memphy_struct *mram, int npages);
+void ksm_cow_copy(struct memphy_struct *mram, int fpn);
+int print_ksm_stat(void);
+
+/* Memory nodes */
+int numa_init(struct memphy_struct *mram, int nnodes, int ncpus, int remote_cost);
+int numa_cpu_node(int cpu);
+int numa_alloc_frame(struct pcb_t *caller, int *retfpn);
+int numa_access(struct pcb_t *caller, int pgn, int *fpn);
+int print_numa_stat(void);
 #endif
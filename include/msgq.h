@@ -0,0 +1,54 @@
+#ifndef MSGQ_H
+#define MSGQ_H
+
+#include "common.h"
+#include "queue.h"
+
+#define MSGQ_MAX 16		/* message queues in the system */
+#define MSGQ_MAX_DEPTH 1024
+
+/* Send and receive flag: fail instead of blocking */
+#define MSGQ_NOWAIT 1
+
+/* Slot of the ring, seq tells whose turn it is */
+struct msgq_cell {
+	uint64_t seq;
+	uint32_t msg;
+};
+
+/* Bounded multi-producer multi-consumer queue of 32-bit messages, a
+ * send or receive is a CAS on its own position. */
+struct msgq {
+	int key;
+	uint32_t mask;		/* depth - 1, depth a power of two */
+	struct msgq_cell * cells;
+
+	uint64_t enq_pos __attribute__((aligned(64)));
+	uint64_t deq_pos __attribute__((aligned(64)));
+
+	/* Processes blocked on a full or an empty queue */
+	struct queue_t senders __attribute__((aligned(64)));
+	struct queue_t receivers;
+
+	unsigned long nsent;
+	unsigned long nrecv;
+	unsigned long nfull;	/* sends that found no room */
+	unsigned long nempty;	/* receives that found nothing */
+	uint64_t first_send;
+	uint64_t last_recv;
+};
+
+/* Queue of key, created with room for depth messages if missing */
+struct msgq * msgq_get(int key, uint32_t depth);
+
+/* Queue of key, NULL if it does not exist */
+struct msgq * msgq_find(int key);
+
+/* 0 on success, -1 when the queue is full / empty */
+int msgq_send(struct msgq * q, uint32_t msg);
+int msgq_recv(struct msgq * q, uint32_t * msg);
+
+/* Messages per queue and per time slot */
+void print_msgq_stat(void);
+
+#endif
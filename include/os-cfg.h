@@ -5,6 +5,7 @@
 #define MAX_PRIO 140
 
 #define MM_PAGING
+//#define MM_DEMAND_PAGING
 //#define MM_FIXED_MEMSZ
 //#define VMDBG 1
 //#define MMDBG 1
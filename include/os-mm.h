@@ -3,7 +3,9 @@
 
 #define MM_PAGING
 #define PAGING_MAX_MMSWP 4 /* max number of supported swapped space */
-#define PAGING_MAX_SYMTBL_SZ 30
+#define PAGING_MAX_SYMTBL_SZ (1 << 16) /* upper bound of region IDs */
+#define PAGING_SYMTBL_CHUNK_SZ 64      /* symbol table growth step */
+#define PAGING_FREERG_NBINS 16 /* size classes of the free region lists */
 
 typedef char BYTE;
 typedef uint32_t addr_t;
@@ -24,6 +26,11 @@ struct vm_rg_struct
    unsigned long rg_end;
 
    struct vm_rg_struct *rg_next;
+   struct vm_rg_struct *rg_prev;
+
+   /* Size-class bin links, only meaningful while the region is free */
+   struct vm_rg_struct *rg_bin_next;
+   struct vm_rg_struct *rg_bin_prev;
 };
 
 /*
@@ -36,12 +43,19 @@ struct vm_area_struct
    unsigned long vm_end;
 
    unsigned long sbrk;
+   unsigned long vm_flags; /* VM_SHARED for a shared memory mapping */
    /*
     * Derived field
     * unsigned long vm_limit = vm_end - vm_start
     */
    struct mm_struct *vm_mm;
+
+   /* Free regions, address-ordered so that neighbours can be coalesced */
    struct vm_rg_struct *vm_freerg_list;
+   struct vm_rg_struct *vm_freerg_last; /* highest free region, if any */
+   /* Same regions segregated by size class, bin i holds [2^i, 2^(i+1)) */
+   struct vm_rg_struct *vm_freerg_bins[PAGING_FREERG_NBINS];
+   unsigned long vm_freerg_binmap; /* bit i set when bin i is not empty */
    struct vm_area_struct *vm_next;
 };
 
@@ -52,13 +66,38 @@ struct mm_struct
 {
    uint32_t *pgd;
 
+   /* VM areas, the list is kept in address order */
    struct vm_area_struct *mmap;
 
-   /* Currently we support a fixed number of symbol */
-   struct vm_rg_struct symrgtbl[PAGING_MAX_SYMTBL_SZ];
+   /* Sorted indexes of the same areas: by vm_start (ties by vm_end) and
+    * by vm_id, giving O(log n) address and ID lookups */
+   struct vm_area_struct **mmap_by_addr;
+   struct vm_area_struct **mmap_by_id;
+   int map_count;
+   int map_cap;
+
+   /* Symbol table, an array of chunks of PAGING_SYMTBL_CHUNK_SZ regions
+    * allocated on first use, a NULL chunk holds no region */
+   struct vm_rg_struct **symrgtbl;
+   int symrgtbl_nchunk;
 
    /* list of free page */
    struct pgn_t *fifo_pgn;
+
+   /* Run of swap slots reserved for the next evictions of this mm, so
+    * that pages evicted one after the other land next to each other */
+   int swp_cltyp;
+   int swp_clnext;
+   int swp_clleft;
+
+   /* Frames this mm owns in the frame table, chained through their
+    * own_next/own_prev, -1 when empty */
+   int owned_fpn;
+   /* Private pages mapped, present or swapped out */
+   int nr_pages;
+
+   /* Link in the list of live address spaces, see mm_register() */
+   struct mm_struct *mm_next;
 };
 
 /*
@@ -73,6 +112,37 @@ struct framephy_struct
    struct mm_struct *owner;
 };
 
+/*
+ * Frame descriptor, one per frame of a MEMPHY device
+ */
+struct framedesc_struct
+{
+   int refcnt; /* number of mappings, 0 when the frame is free */
+   int flags;
+
+   /* Reverse mapping of a MEMRAM frame to the PTE that last mapped it,
+    * exact for frames with a single mapping. The frame sits on the owned
+    * list of owner, see MEMPHY_set_owner() */
+   struct mm_struct *owner;
+   int pgn;
+   int own_next;
+   int own_prev;
+
+   /* Swap cache: the MEMRAM frame still holds the same data as this
+    * swap slot, and owns one reference of it */
+   struct memphy_struct *swpdev;
+   int swptyp;
+   int swpoff;
+
+   /* Memory node of the frame, and the remote node that accessed it
+    * last with the length of its run of accesses */
+   int nid;
+   int acc_nid;
+   int acc_cnt;
+};
+
+#define MEMPHY_MAX_NODES 8
+
 struct memphy_struct
 {
    /* Basic field of data and size */
@@ -83,9 +153,17 @@ struct memphy_struct
    int rdmflg;
    int cursor;
 
-   /* Management structure */
-   struct framephy_struct *free_fp_list;
+   /* Management structure, frames are split into nnodes memory nodes of
+    * contiguous FPNs, each with its own free list */
+   struct framephy_struct *free_fp_list[MEMPHY_MAX_NODES];
    struct framephy_struct *used_fp_list;
+   int node_free_cnt[MEMPHY_MAX_NODES];
+   int free_fp_cnt; /* length of all free lists */
+   int nnodes;
+
+   /* Frame table indexed by FPN */
+   struct framedesc_struct *frmtbl;
+   int maxfpn;
 };
 
 #endif
@@ -11,10 +11,14 @@ struct queue_t {
 	int size;
 };
 
-void enqueue(struct queue_t * q, struct pcb_t * proc);
+/* 0 on success, -1 when q is full */
+int enqueue(struct queue_t * q, struct pcb_t * proc);
 
 struct pcb_t * dequeue(struct queue_t * q);
 
+/* Remove the process at position index, 0 being the head */
+struct pcb_t * dequeue_at(struct queue_t * q, int index);
+
 int empty(struct queue_t * q);
 
 #endif
@@ -0,0 +1,36 @@
+#ifndef RBTREE_H
+#define RBTREE_H
+
+#include <stddef.h>
+
+/* Red-black tree node, embedded in the struct it orders */
+struct rb_node {
+	struct rb_node * parent;
+	struct rb_node * left;
+	struct rb_node * right;
+	int red;
+};
+
+struct rb_root {
+	struct rb_node * node;
+	struct rb_node * leftmost; /* cached smallest node */
+	int count;
+};
+
+#define RB_ROOT_INIT { NULL, NULL, 0 }
+
+#define rb_entry(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+/* Insert a node, it goes after the nodes it is not less than */
+void rb_insert(struct rb_root * root, struct rb_node * node,
+	int (*less)(const struct rb_node *, const struct rb_node *));
+
+void rb_erase(struct rb_root * root, struct rb_node * node);
+
+/* Smallest node, NULL for an empty tree */
+struct rb_node * rb_first(struct rb_root * root);
+
+struct rb_node * rb_next(struct rb_node * node);
+
+#endif
@@ -1,7 +1,8 @@
-#ifndef QUEUE_H
-#define QUEUE_H
+#ifndef SCHED_H
+#define SCHED_H
 
 #include "common.h"
+#include "queue.h"
 
 #ifndef MLQ_SCHED
 #define MLQ_SCHED
@@ -9,19 +10,88 @@
 
 #define MAX_PRIO 140
 
+/* Scheduling policies, chosen with the SCHED config line */
+#define SCHED_POLICY_MLQ 0
+#define SCHED_POLICY_CFS 1
+
+/* Load weight of a process of nice 0 */
+#define CFS_NICE_0_WEIGHT 1024
+
+/* Lag in vruntime a process that last ran on the picking CPU may have
+ * over the leftmost one and still go first */
+#define CFS_MIGRATE_GRAN CFS_NICE_0_WEIGHT
+
 int queue_empty(void);
 
 void init_scheduler(void);
 void finish_scheduler(void);
 
-/* Get the next process from ready queue */
-struct pcb_t * get_proc(void);
+/* Get the next process from ready queue that may run on a CPU, the
+ * ones that last ran there come first */
+struct pcb_t * get_proc(int cpu);
+
+/* Put a process back to run queue, expired when it used its whole
+ * quantum rather than being preempted */
+void put_proc(struct pcb_t * proc, int expired);
+
+/* Add a new process to ready queue, -1 when there is no room for it */
+int add_proc(struct pcb_t * proc);
+
+int sched_set_policy(int policy);
+void sched_set_ncpus(int ncpus);
+
+/* Slots a process loses to a cold cache when dispatched on a new CPU */
+void sched_set_migration_cost(int slots);
+
+/* Quantum of a process, in time slots, looked up by its prio */
+void sched_set_default_quantum(int slots);
+int sched_set_quantum(int prio_lo, int prio_hi, int slots);
+int sched_quantum(struct pcb_t * proc);
+
+/* A process that ran ran slots of its quantum should give the CPU up
+ * now. Quanta are only cut past the default one. */
+int sched_need_resched(struct pcb_t * proc, int ran);
+
+/* MLQ aging: a ready process gains one level per slots time slots of
+ * waiting and loses penalty levels when it uses up its time slice */
+int sched_set_aging(int slots, int penalty);
+
+/* Restrict process pid (0 for the caller) to the CPUs set in mask */
+int sched_set_affinity(struct pcb_t * caller, uint32_t pid, uint32_t mask);
+
+/* Blocking, for the instruction a CPU is running. The process leaves
+ * the CPU once the instruction is done, see sched_sleep(). */
+void sched_block(struct pcb_t * proc, int slots);
+int sched_wait(struct queue_t * wq, struct pcb_t * proc);
+
+/* Take back a sched_wait() whose condition came true meanwhile */
+void sched_wait_cancel(struct queue_t * wq, struct pcb_t * proc);
+
+/* Make up to nr processes of a wait queue ready again, the number woken
+ * is returned */
+int sched_wake(struct queue_t * wq, int nr);
+
+/* Called by the CPU after each instruction: turns the device time it
+ * started into a block, in blocking mode, and takes proc off the CPU
+ * when it blocked. Returns 1 in that case. */
+int sched_sleep(struct pcb_t * proc);
+
+/* Device time blocks the process (default) or keeps it on its CPU */
+void sched_set_io_block(int block);
+
+/* Some process is blocked and may still need a CPU */
+int sched_has_blocked(void);
+
+/* Kill every process but caller loaded from path. Each one is torn down
+ * by the CPU it runs on next, a blocked one is woken for it. Return the
+ * number killed. */
+int sched_kill(const char * path, struct pcb_t * caller);
 
-/* Put a process back to run queue */
-void put_proc(struct pcb_t * proc);
+/* Account a finished process before it is freed */
+void sched_exit(struct pcb_t * proc);
 
-/* Add a new process to ready queue */
-void add_proc(struct pcb_t * proc);
+/* Per process turnaround, waiting and fairness figures */
+void print_sched_stat(void);
 
 #endif
 
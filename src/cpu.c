@@ -4,6 +4,37 @@
 #include "mm.h"
 #include "syscall.h"
 #include "libmem.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_REGS_INIT 10
+
+/* Return register [reg_index] of [proc], growing the register file
+ * when needed. Return NULL if the index is out of bound. */
+static addr_t *get_reg(struct pcb_t *proc, uint32_t reg_index)
+{
+	uint32_t nregs;
+	addr_t *regs;
+
+	if (reg_index >= PAGING_MAX_SYMTBL_SZ)
+		return NULL;
+
+	if (reg_index >= proc->nregs)
+	{
+		nregs = (proc->nregs > 0) ? proc->nregs : NUM_REGS_INIT;
+		while (nregs <= reg_index)
+			nregs *= 2;
+
+		regs = (addr_t *)realloc(proc->regs, nregs * sizeof(addr_t));
+		if (regs == NULL)
+			return NULL;
+		memset(regs + proc->nregs, 0, (nregs - proc->nregs) * sizeof(addr_t));
+		proc->regs = regs;
+		proc->nregs = nregs;
+	}
+
+	return &proc->regs[reg_index];
+}
 
 int calc(struct pcb_t *proc)
 {
@@ -12,6 +43,12 @@ int calc(struct pcb_t *proc)
 
 int alloc(struct pcb_t *proc, uint32_t size, uint32_t reg_index)
 {
+	addr_t *reg = get_reg(proc, reg_index);
+	if (reg == NULL)
+	{
+		return 1;
+	}
+
 	addr_t addr = alloc_mem(size, proc);
 	if (addr == 0)
 	{
@@ -19,14 +56,19 @@ int alloc(struct pcb_t *proc, uint32_t size, uint32_t reg_index)
 	}
 	else
 	{
-		proc->regs[reg_index] = addr;
+		*reg = addr;
 		return 0;
 	}
 }
 
 int free_data(struct pcb_t *proc, uint32_t reg_index)
 {
-	return free_mem(proc->regs[reg_index], proc);
+	addr_t *reg = get_reg(proc, reg_index);
+	if (reg == NULL)
+	{
+		return 1;
+	}
+	return free_mem(*reg, proc);
 }
 
 int read(
@@ -37,9 +79,15 @@ int read(
 { // Index of destination register
 
 	BYTE data;
-	if (read_mem(proc->regs[source] + offset, proc, &data))
+	addr_t *src = get_reg(proc, source);
+	addr_t *dst = get_reg(proc, destination);
+	if (src == NULL || dst == NULL)
+	{
+		return 1;
+	}
+	if (read_mem(*src + offset, proc, &data))
 	{
-		proc->regs[destination] = data;
+		*dst = data;
 		return 0;
 	}
 	else
@@ -55,7 +103,12 @@ int write(
 	uint32_t offset)
 { // Destination address =
 	// [destination] + [offset]
-	return write_mem(proc->regs[destination] + offset, proc, data);
+	addr_t *dst = get_reg(proc, destination);
+	if (dst == NULL)
+	{
+		return 1;
+	}
+	return write_mem(*dst + offset, proc, data);
 }
 
 int run(struct pcb_t *proc)
@@ -69,6 +122,12 @@ int run(struct pcb_t *proc)
 	struct inst_t ins = proc->code->text[proc->pc];
 	proc->pc++;
 	int stat = 1;
+#ifdef MM_PAGING
+	/* The register of a region holds its start, as in alloc() */
+	struct vm_rg_struct *rg;
+	uint32_t data;
+	addr_t *reg;
+#endif
 switch (ins.opcode)
 	{
 	case CALC:
@@ -76,28 +135,41 @@ switch (ins.opcode)
 		break;
 	case ALLOC:
 #ifdef MM_PAGING
-		stat = liballoc(proc, ins.arg_0, ins.arg_1);
+		reg = get_reg(proc, ins.arg_1);
+		stat = reg == NULL ? 1 : liballoc(proc, ins.arg_0, ins.arg_1);
+		if (stat == 0)
+		{
+			rg = get_symrg_byid(proc->mm, ins.arg_1);
+			*reg = rg->rg_start;
+		}
 #else
 		stat = alloc(proc, ins.arg_0, ins.arg_1);
 #endif
 		break;
 	case FREE:
 #ifdef MM_PAGING
-		stat = libfree(proc, ins.arg_0);
+		reg = get_reg(proc, ins.arg_0);
+		stat = reg == NULL ? 1 : libfree(proc, ins.arg_0);
+		if (stat == 0)
+			*reg = 0;
 #else
 		stat = free_data(proc, ins.arg_0);
 #endif
 		break;
 	case READ:
 #ifdef MM_PAGING
-		stat = libread(proc, ins.arg_0, ins.arg_1, &ins.arg_2);
+		reg = get_reg(proc, ins.arg_2);
+		stat = reg == NULL ? 1 : libread(proc, ins.arg_0, ins.arg_1, &data);
+		if (stat == 0)
+			*reg = data;
 #else
 		stat = read(proc, ins.arg_0, ins.arg_1, ins.arg_2);
 #endif
 		break;
 	case WRITE:
 #ifdef MM_PAGING
-		stat = libwrite(proc, ins.arg_0, ins.arg_1, ins.arg_2);
+		reg = get_reg(proc, ins.arg_1);
+		stat = reg == NULL ? 1 : libwrite(proc, ins.arg_0, ins.arg_1, ins.arg_2);
 #else
 		stat = write(proc, ins.arg_0, ins.arg_1, ins.arg_2);
 #endif
@@ -23,42 +23,245 @@
 #include <stdio.h>
 #include <pthread.h>
 
-static pthread_mutex_t mmvm_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t mmvm_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*freerg_bin_idx - size class of a free region
+ *@size: region size in bytes
+ *
+ * Bin i holds the regions of size [2^i, 2^(i+1)), the last bin is open ended.
+ */
+static int freerg_bin_idx(unsigned long size)
+{
+  int bin = 0;
+
+  while ((size >>= 1) != 0 && bin < PAGING_FREERG_NBINS - 1)
+    bin++;
+
+  return bin;
+}
+
+/*freerg_bin_insert - push a free region on the head of its size class bin
+ *@vma: vm area owning the region
+ *@rg: free region
+ */
+static void freerg_bin_insert(struct vm_area_struct *vma, struct vm_rg_struct *rg)
+{
+  int bin = freerg_bin_idx(rg->rg_end - rg->rg_start);
+
+  rg->rg_bin_prev = NULL;
+  rg->rg_bin_next = vma->vm_freerg_bins[bin];
+  if (rg->rg_bin_next != NULL)
+    rg->rg_bin_next->rg_bin_prev = rg;
+
+  vma->vm_freerg_bins[bin] = rg;
+  vma->vm_freerg_binmap |= BIT_MASK(bin);
+}
+
+/*freerg_bin_remove - unlink a free region from its size class bin
+ *@vma: vm area owning the region
+ *@rg: free region, its bounds must not have changed since insertion
+ */
+static void freerg_bin_remove(struct vm_area_struct *vma, struct vm_rg_struct *rg)
+{
+  int bin = freerg_bin_idx(rg->rg_end - rg->rg_start);
+
+  if (rg->rg_bin_prev != NULL)
+    rg->rg_bin_prev->rg_bin_next = rg->rg_bin_next;
+  else
+    vma->vm_freerg_bins[bin] = rg->rg_bin_next;
+
+  if (rg->rg_bin_next != NULL)
+    rg->rg_bin_next->rg_bin_prev = rg->rg_bin_prev;
+
+  if (vma->vm_freerg_bins[bin] == NULL)
+    vma->vm_freerg_binmap &= ~BIT_MASK(bin);
+
+  rg->rg_bin_next = rg->rg_bin_prev = NULL;
+}
+
+/*freerg_unlink - drop a free region from the address-ordered list
+ *@vma: vm area owning the region
+ *@rg: free region
+ */
+static void freerg_unlink(struct vm_area_struct *vma, struct vm_rg_struct *rg)
+{
+  if (rg->rg_prev != NULL)
+    rg->rg_prev->rg_next = rg->rg_next;
+  else
+    vma->vm_freerg_list = rg->rg_next;
+
+  if (rg->rg_next != NULL)
+    rg->rg_next->rg_prev = rg->rg_prev;
+  else
+    vma->vm_freerg_last = rg->rg_prev;
+}
 
 /*enlist_vm_freerg_list - add new rg to freerg_list
- *@mm: memory region
- *@rg_elmt: new region
+ *@vma: vm area owning the region
+ *@rg_elmt: new region, ownership is taken over by the free list
  *
+ * The region is inserted in address order and merged with its lower and
+ * upper neighbours when they are adjacent, so the heap never fragments
+ * into pieces that together could have served a request. Regions above
+ * the highest one, as heap growth produces, skip the walk.
  */
-int enlist_vm_freerg_list(struct mm_struct *mm, struct vm_rg_struct *rg_elmt) // Thêm vùng nhớ đã giải phóng vào danh sách vùng trống
+int enlist_vm_freerg_list(struct vm_area_struct *vma, struct vm_rg_struct *rg_elmt)
 {
-  struct vm_rg_struct *rg_node = mm->mmap->vm_freerg_list;
+  struct vm_rg_struct *prev = NULL;
+  struct vm_rg_struct *next = vma->vm_freerg_list;
 
   if (rg_elmt->rg_start >= rg_elmt->rg_end)
+  {
+    free(rg_elmt);
     return -1;
+  }
 
-  if (rg_node != NULL)
-    rg_elmt->rg_next = rg_node;
+  if (vma->vm_freerg_last != NULL && vma->vm_freerg_last->rg_start < rg_elmt->rg_start)
+  {
+    prev = vma->vm_freerg_last;
+    next = NULL;
+  }
 
-  /* Enlist the new region */
-  mm->mmap->vm_freerg_list = rg_elmt;
+  while (next != NULL && next->rg_start < rg_elmt->rg_start)
+  {
+    prev = next;
+    next = next->rg_next;
+  }
+
+  if (prev != NULL && prev->rg_end == rg_elmt->rg_start)
+  {
+    /* Coalesce with the lower neighbour */
+    freerg_bin_remove(vma, prev);
+    prev->rg_end = rg_elmt->rg_end;
+    free(rg_elmt);
+    rg_elmt = prev;
+  }
+  else
+  {
+    rg_elmt->rg_prev = prev;
+    rg_elmt->rg_next = next;
+    if (prev != NULL)
+      prev->rg_next = rg_elmt;
+    else
+      vma->vm_freerg_list = rg_elmt;
+    if (next != NULL)
+      next->rg_prev = rg_elmt;
+    else
+      vma->vm_freerg_last = rg_elmt;
+  }
+
+  if (next != NULL && rg_elmt->rg_end == next->rg_start)
+  {
+    /* Coalesce with the upper neighbour */
+    freerg_bin_remove(vma, next);
+    rg_elmt->rg_end = next->rg_end;
+    freerg_unlink(vma, next);
+    free(next);
+  }
+
+  freerg_bin_insert(vma, rg_elmt);
 
   return 0;
 }
 
+/*get_freerg_tail - size of the free region ending at the break
+ *@vma: vm area
+ *
+ */
+static unsigned long get_freerg_tail(struct vm_area_struct *vma)
+{
+  struct vm_rg_struct *rg = vma->vm_freerg_last;
+
+  if (rg == NULL || rg->rg_end != vma->sbrk)
+    return 0;
+
+  return rg->rg_end - rg->rg_start;
+}
+
 /*get_symrg_byid - get mem region by region ID
  *@mm: memory region
  *@rgid: region ID act as symbol index of variable
  *
+ * Return NULL when the ID is out of bound or its chunk was never used.
  */
-struct vm_rg_struct *get_symrg_byid(struct mm_struct *mm, int rgid) // Lấy thông tin vùng nhớ của một biến (dựa vào symrgtbl)
+struct vm_rg_struct *get_symrg_byid(struct mm_struct *mm, int rgid)
 {
-  if (rgid < 0 || rgid > PAGING_MAX_SYMTBL_SZ)
+  int chunk;
+
+  if (rgid < 0 || rgid >= PAGING_MAX_SYMTBL_SZ)
   {
     return NULL;
   }
 
-  return &mm->symrgtbl[rgid];
+  chunk = rgid / PAGING_SYMTBL_CHUNK_SZ;
+  if (chunk >= mm->symrgtbl_nchunk || mm->symrgtbl[chunk] == NULL)
+    return NULL;
+
+  return &mm->symrgtbl[chunk][rgid % PAGING_SYMTBL_CHUNK_SZ];
+}
+
+/*get_symrg_slot - get mem region by region ID, growing the table to hold it
+ *@mm: memory region
+ *@rgid: region ID act as symbol index of variable
+ *
+ */
+struct vm_rg_struct *get_symrg_slot(struct mm_struct *mm, int rgid)
+{
+  int chunk, nchunk;
+  struct vm_rg_struct **tbl;
+
+  if (rgid < 0 || rgid >= PAGING_MAX_SYMTBL_SZ)
+    return NULL;
+
+  chunk = rgid / PAGING_SYMTBL_CHUNK_SZ;
+  if (chunk >= mm->symrgtbl_nchunk)
+  {
+    /* Double the chunk directory so that growing stays amortized O(1) */
+    nchunk = (mm->symrgtbl_nchunk > 0) ? mm->symrgtbl_nchunk : 1;
+    while (nchunk <= chunk)
+      nchunk *= 2;
+
+    tbl = realloc(mm->symrgtbl, nchunk * sizeof(struct vm_rg_struct *));
+    if (tbl == NULL)
+      return NULL;
+    memset(tbl + mm->symrgtbl_nchunk, 0,
+           (nchunk - mm->symrgtbl_nchunk) * sizeof(struct vm_rg_struct *));
+    mm->symrgtbl = tbl;
+    mm->symrgtbl_nchunk = nchunk;
+  }
+
+  if (mm->symrgtbl[chunk] == NULL)
+  {
+    mm->symrgtbl[chunk] = calloc(PAGING_SYMTBL_CHUNK_SZ, sizeof(struct vm_rg_struct));
+    if (mm->symrgtbl[chunk] == NULL)
+      return NULL;
+  }
+
+  return &mm->symrgtbl[chunk][rgid % PAGING_SYMTBL_CHUNK_SZ];
+}
+
+/*put_symrg - unbind a symbol from its region and release the region
+ *@caller: caller
+ *@vma: vm area whose free lists take the region back
+ *@rg: live symbol region
+ *
+ * A shared memory mapping is detached and its area removed instead.
+ */
+static void put_symrg(struct pcb_t *caller, struct vm_area_struct *vma, struct vm_rg_struct *rg)
+{
+  struct mm_struct *mm = caller->mm;
+  struct vm_area_struct *rgvma = find_vma(mm, rg->rg_start);
+
+  if (rgvma != NULL && (rgvma->vm_flags & VM_SHARED))
+  {
+    shm_detach(caller->mram, mm, rgvma);
+    remove_vm_area(mm, rgvma);
+    free(rgvma);
+  }
+  else
+    enlist_vm_freerg_list(vma, init_vm_rg(rg->rg_start, rg->rg_end));
+
+  rg->rg_start = rg->rg_end = 0;
 }
 
 /*__alloc - allocate a region memory
@@ -73,61 +276,70 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, int size, int *alloc_addr
 {
   /*Allocate at the toproof */
   struct vm_rg_struct rgnode;
+  struct vm_rg_struct *symrg;
+  struct vm_area_struct *cur_vma;
+
+  if (size <= 0)
+    return -1;
 
   /* TODO: commit the vmaid */
   // rgnode.vmaid
-  pthread_mutex_lock(&mmvm_lock); // update
-  if (get_free_vmrg_area(caller, vmaid, size, &rgnode) == 0) // tìm vùng trống trong VM, nếu tìm thấy (== 0)
+  pthread_mutex_lock(&mmvm_lock);
+  cur_vma = get_vma_by_num(caller->mm, vmaid);
+  symrg = get_symrg_slot(caller->mm, rgid);
+  if (cur_vma == NULL || symrg == NULL)
   {
-    caller->mm->symrgtbl[rgid].rg_start = rgnode.rg_start;
-    caller->mm->symrgtbl[rgid].rg_end = rgnode.rg_end;
-    *alloc_addr = rgnode.rg_start;
-
     pthread_mutex_unlock(&mmvm_lock);
-    return 0;
+    return -1;
   }
 
-  // Nếu không còn vùng trống, sẽ gọi syscall để mở rộng giới hạn vùng nhớ (sbrk)
-  /* TODO get_free_vmrg_area FAILED handle the region management (Fig.6)*/
-  /* TODO retrive current vma if needed, current comment out due to compiler redundant warning*/
-  /*Attempt to increate limit to get space */
-  struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
-  
-  int inc_sz = PAGING_PAGE_ALIGNSZ(size);
-  // int inc_limit_ret;
-  
-  /* TODO retrive old_sbrk if needed, current comment out due to compiler redundant warning*/
-  int old_sbrk = cur_vma->sbrk;
-  
-  /* TODO INCREASE THE LIMIT as invoking systemcall
-  * sys_memap with SYSMEM_INC_OP
-  */
- struct sc_regs regs;
- regs.a1 = SYSMEM_INC_OP;
- regs.a2 = vmaid;
- regs.a3 = inc_sz; // size mở rộng
- 
- /* SYSCALL 17 sys_memmap */
- regs.orig_ax = 17;
- if (syscall(caller, regs.orig_ax, &regs) != 0) // nếu mở rộng không thành công
+  if (get_free_vmrg_area(caller, vmaid, size, &rgnode) != 0)
   {
-    regs.flags = -1;                    // failed
-    perror("failed to increase limit"); // in syscall
-    pthread_mutex_unlock(&mmvm_lock);   //
-    return -1;
+    /* No free region fits, grow the area by what the free tail right
+     * below the break cannot cover and hand the new space to the free
+     * lists, where it merges with that tail.
+     */
+    int inc_sz = PAGING_PAGE_ALIGNSZ(size - get_freerg_tail(cur_vma));
+    int old_sbrk = cur_vma->sbrk;
+
+    /* INCREASE THE LIMIT as invoking systemcall
+     * sys_memap with SYSMEM_INC_OP
+     */
+    struct sc_regs regs;
+    regs.a1 = SYSMEM_INC_OP;
+    regs.a2 = vmaid;
+    regs.a3 = inc_sz;
+
+    /* SYSCALL 17 sys_memmap */
+    regs.orig_ax = 17;
+    if (syscall(caller, regs.orig_ax, &regs) != 0)
+    {
+      regs.flags = -1;                    // failed
+      perror("failed to increase limit"); // in syscall
+      pthread_mutex_unlock(&mmvm_lock);
+      return -1;
+    }
+    regs.flags = 0; // successful
+
+    enlist_vm_freerg_list(cur_vma, init_vm_rg(old_sbrk, old_sbrk + inc_sz));
+
+    if (get_free_vmrg_area(caller, vmaid, size, &rgnode) != 0)
+    {
+      pthread_mutex_unlock(&mmvm_lock);
+      return -1;
+    }
   }
-  regs.flags = 0; // successful
 
-  /* TODO: commit the limit increment */
-  caller->mm->symrgtbl[rgid].rg_start = old_sbrk;        // bắt đầu từ limit cũ
-  caller->mm->symrgtbl[rgid].rg_end = old_sbrk + inc_sz; // kết thúc ở limit đã mở rộng
+  /* Commit the allocation to the symbol table, a region ID that is
+   * rebound gives its previous region back to the free lists */
+  if (symrg->rg_start < symrg->rg_end)
+    put_symrg(caller, cur_vma, symrg);
+  symrg->rg_start = rgnode.rg_start;
+  symrg->rg_end = rgnode.rg_end;
+  *alloc_addr = rgnode.rg_start;
 
-  /* TODO: commit the allocation address */
-  // *alloc_addr = caller->mm->symrgtbl[rgid].rg_end - inc_sz;
-  *alloc_addr = old_sbrk;
-  pthread_mutex_unlock(&mmvm_lock); //
+  pthread_mutex_unlock(&mmvm_lock);
   return 0;
-  // return inc_limit_ret;
 }
 
 /*__free - remove a region memory
@@ -139,22 +351,24 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, int size, int *alloc_addr
  */
 int __free(struct pcb_t *caller, int vmaid, int rgid)
 {
-  struct vm_rg_struct rgnode;
-  // Dummy initialization for avoding compiler dummy warning
-  // in incompleted TODO code rgnode will overwrite through implementing
-  // the manipulation of rgid later
+  struct vm_rg_struct *rgnode;
+  struct vm_area_struct *cur_vma;
+
+  pthread_mutex_lock(&mmvm_lock);
+  cur_vma = get_vma_by_num(caller->mm, vmaid);
+  rgnode = get_symrg_byid(caller->mm, rgid);
 
-  if (rgid < 0 || rgid > PAGING_MAX_SYMTBL_SZ)
+  /* Reject double free and never allocated region */
+  if (cur_vma == NULL || rgnode == NULL || rgnode->rg_start >= rgnode->rg_end)
   {
+    pthread_mutex_unlock(&mmvm_lock);
     return -1;
   }
 
-  // thu hồi vùng nhớ và đưa vào danh sách vùng nhớ trống freerg_list
-  /* TODO: Manage the collect freed region to freerg_list */
-  rgnode = *get_symrg_byid(caller->mm, rgid);
   /*enlist the obsoleted memory region */
-  enlist_vm_freerg_list(caller->mm, &rgnode);
+  put_symrg(caller, cur_vma, rgnode);
 
+  pthread_mutex_unlock(&mmvm_lock);
   return 0;
 }
 
@@ -166,16 +380,19 @@ int __free(struct pcb_t *caller, int vmaid, int rgid)
 int liballoc(struct pcb_t *proc, uint32_t size, uint32_t reg_index)
 {
   /* TODO Implement allocation on vm area 0 */
-  int addr;
+  int addr = 0;
   /* By default using vmaid = 0 */
   int val = __alloc(proc, 0, reg_index, size, &addr);
 #ifdef IODUMP
+  /* Another CPU may fault pages in meanwhile, dump under the mm lock */
+  pthread_mutex_lock(&mmvm_lock);
   printf("===== PHYSICAL MEMORY AFTER ALLOCATION =====\n");
   printf("PID=%d - Region=%d - Address=%08ld - Size=%d byte\n", proc->pid, reg_index, addr * sizeof(uint32_t), size);
 #ifdef PAGETBL_DUMP
   print_pgtbl(proc, 0, -1); // print max TBL
 #endif
   MEMPHY_dump(proc->mram);
+  pthread_mutex_unlock(&mmvm_lock);
 #endif
   // print page number -> frame number, after will print ===========
   return val;
@@ -194,12 +411,14 @@ int libfree(struct pcb_t *proc, uint32_t reg_index)
   /* By default using vmaid = 0 */
   int val = __free(proc, 0, reg_index);
 #ifdef IODUMP
+  pthread_mutex_lock(&mmvm_lock);
   printf("===== PHYSICAL MEMORY AFTER DEALLOCATION =====\n");
   printf("PID=%d - Region=%d\n", proc->pid, reg_index);
 #ifdef PAGETBL_DUMP
   print_pgtbl(proc, 0, -1); // print max TBL
 #endif
   MEMPHY_dump(proc->mram);
+  pthread_mutex_unlock(&mmvm_lock);
 #endif
   // print page number -> frame number, after will print ===========
   return val;
@@ -213,107 +432,71 @@ int libfree(struct pcb_t *proc, uint32_t reg_index)
  *
  */
 int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
-// Kiểm tra page có đang hiện diện trong RAM không => swap page nếu không có
 {
-  // pte: entry của page cần truy cập từ bảng trang (Page Table Entry)
-  uint32_t pte = mm->pgd[pgn]; // pgd: Page Table Directory, pgd[pgn] -> framenum (fpn)
-
-  if (!PAGING_PAGE_PRESENT(pte))
-  // thực hiện thuật toán chọn victim page, gọi syscall để swap out/in, và cập nhật lại bảng trang
-  {             /* Page is not online, make it actively living */
-    int vicpgn; // số page của victim
-    int swpfpn; // frame trong swap để chứa dữ liệu của victim
-    int vicfpn; // frame vật lý của victim
-    uint32_t vicpte;
-
-    int tgtfpn = PAGING_PTE_SWP(pte); // the target frame storing our variable (frame trong swap chứa dữ liệu cần lấy lại)
-
-    /* TODO: Play with your paging theory here */
-    /* Find victim page */
-    find_victim_page(caller->mm, &vicpgn); // chon page free
-
-    /* Get free frame in MEMSWP */
-    // Lấy 1 frame trống trong swap để chứa victim page
-    MEMPHY_get_freefp(caller->active_mswp, &swpfpn);
-
-    /* TODO: Implement swap frame from MEMRAM to MEMSWP and vice versa*/
-
-    // Swap victim frame từ RAM -> SWP, (Swap out): đưa dữ liệu của victim từ RAM -> SWAP
-    /* TODO copy victim frame to swap
-     * SWP(vicfpn <--> swpfpn)
-     * SYSCALL 17 sys_memmap
-     * with operation SYSMEM_SWP_OP
-     */
-    vicpte = mm->pgd[vicpgn];
-    vicfpn = PAGING_PTE_FPN(vicpte);
+  uint32_t pte;
+  int tgtfpn, swapped;
 
-    struct sc_regs regs;
-    regs.a1 = SYSMEM_SWP_OP;
-    regs.a2 = vicfpn;
-    regs.a3 = swpfpn;
-    regs.orig_ax = 17;
+  if (pgn < 0 || pgn >= PAGING_MAX_PGN)
+    return -1;
 
-    /* SYSCALL 17 sys_memmap */
+  pte = mm->pgd[pgn];
 
-    /* TODO copy target frame form swap to mem
-     * SWP(tgtfpn <--> vicfpn)
-     * SYSCALL 17 sys_memmap
-     * with operation SYSMEM_SWP_OP
-     */
+  if (PAGING_PAGE_PRESENT(pte) && (pte & PAGING_PTE_READAHEAD_MASK))
+  {
+    /* First access of a page read ahead */
+    CLRBIT(mm->pgd[pgn], PAGING_PTE_READAHEAD_MASK);
+    mm_stat.ra_hits++;
+  }
 
-    if (syscall(caller, regs.orig_ax, &regs) != 0)
+  if (!PAGING_PAGE_PRESENT(pte))
+  { /* Page is not online, make it actively living */
+    if (!PAGING_PAGE_SWAPPED(pte))
     {
-      regs.flags = -1; // failed
-      return -1;
-    }
+      if (!paging_get_demand())
+        return -1; /* page was never mapped */
 
-    regs.flags = 0; // successful
+      /* First touch of a page the area only reserved */
+      if (find_vma(mm, (unsigned long)pgn * PAGING_PAGESZ) == NULL)
+        return -1; /* invalid page access */
+    }
 
-    // Swap in: lấy dữ liệu từ swap (target page) vào frame RAM vừa giải phóng
-    /* TODO copy target frame form swap to mem
-    //regs.a1 =...
-    //regs.a2 =...
-    //regs.a3 =..
-    */
+    mm_stat.pgfault++;
 
-    regs.a2 = tgtfpn; // đang ở swap
-    regs.a3 = vicfpn; // nơi cần đưa vào RAM
+    /* Get a MEMRAM frame, evicting a victim to MEMSWP when RAM is full */
+    if (get_free_frame(caller, &tgtfpn) < 0)
+      return -1;
 
-    /* SYSCALL 17 sys_memmap */
-    if (syscall(caller, regs.orig_ax, &regs) != 0)
+    if (PAGING_PAGE_SWAPPED(pte))
     {
-      regs.flags = -1; // failed
-      return -1;
+      /* Swap in: copy the target page from its swap slot */
+      if (swap_in_page(caller, pgn, tgtfpn) < 0)
+      {
+        MEMPHY_put_freefp(caller->mram, tgtfpn);
+        return -1;
+      }
+    }
+    else
+    {
+      __zero_fill_page(caller->mram, tgtfpn);
+      mm_stat.pgfault_zero++;
+      mm->nr_pages++;
     }
-
-    regs.flags = 0; // successful
-
-    /* Update page table */
-    // Update victim PTE: đã bị swap ra (swap out)
-    uint32_t swptyp = caller->active_mswp_id;
-    pte_set_swap(&vicpte, swptyp, swpfpn); // đánh dấu trang đã bị swap ra và frame swap đang lưu trang đó
-    mm->pgd[vicpgn] = vicpte;
 
     /* Update its online status of the target page */
-    // Update target PTE: đã được swap vào RAM
-    // pte_set_fpn() &
-    // mm->pgd[pgn];
-    // pte_set_fpn();
-    // Update lại PTE của trang đang truy cập (present + frame mới)
-    // pte = vicpte; không làm mm->pgd[pgn] thay đổi
-
-    // Update target PTE (pgn)
-    pte_set_fpn(&pte, vicfpn);   // RAM frame mới của page cần truy cập
-    PAGING_PTE_SET_PRESENT(pte); // Đánh dấu present
-    mm->pgd[pgn] = pte;          // Cập nhật lại PTE vào bảng trang thật
-
-    // printf("Swapping out victim page %d (fpn=%d) to swpfpn=%d\n", vicpgn, vicfpn, swpfpn);
-    // printf("Swapping in target page %d (tgtfpn=%d) to fpn=%d\n", pgn, tgtfpn, vicfpn);
+    swapped = PAGING_PAGE_SWAPPED(pte);
+    pte_set_fpn(&pte, tgtfpn);
+    mm->pgd[pgn] = pte;
+    MEMPHY_set_owner(caller->mram, tgtfpn, mm, pgn);
 
     enlist_pgn_node(&caller->mm->fifo_pgn, pgn);
+
+    /* Its neighbours were likely evicted along with it */
+    if (swapped)
+      swapin_readahead(caller, pgn);
   }
 
   *fpn = PAGING_FPN(pte);
+  caller->mram->frmtbl[*fpn].flags |= FRAME_REFERENCED;
 
   return 0;
 }
@@ -336,6 +519,7 @@ int pg_getval(struct mm_struct *mm, int addr, BYTE *data, struct pcb_t *caller)
   {
     return -1; /* invalid page access */
   }
+  numa_access(caller, pgn, &fpn);
 
   /* TODO
    *  MEMPHY_read(caller->mram, phyaddr, data);
@@ -383,6 +567,17 @@ int pg_setval(struct mm_struct *mm, int addr, BYTE value, struct pcb_t *caller)
     return -1; /* invalid page access */
   }
 
+  /* Write to a shared page, get a private copy first */
+  if ((mm->pgd[pgn] & PAGING_PTE_COW_MASK) && do_cow_page(caller, pgn, &fpn) != 0)
+  {
+    return -1;
+  }
+
+  numa_access(caller, pgn, &fpn);
+
+  /* The swap copy of the page, if any, is now stale */
+  SETBIT(mm->pgd[pgn], PAGING_PTE_DIRTY_MASK);
+
   /* TODO
    *  MEMPHY_write(caller->mram, phyaddr, value);
    *  MEMPHY WRITE
@@ -423,12 +618,17 @@ int __read(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE *data)
   struct vm_rg_struct *currg = get_symrg_byid(caller->mm, rgid);
   struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
 
-  if (currg == NULL || cur_vma == NULL) /* Invalid memory identify */
+  int ret;
+
+  if (currg == NULL || cur_vma == NULL || /* Invalid memory identify */
+      currg->rg_start >= currg->rg_end)  /* Region is not allocated */
     return -1;
 
-  pg_getval(caller->mm, currg->rg_start + offset, data, caller);
+  pthread_mutex_lock(&mmvm_lock);
+  ret = pg_getval(caller->mm, currg->rg_start + offset, data, caller);
+  pthread_mutex_unlock(&mmvm_lock);
 
-  return 0;
+  return ret;
 }
 
 /*libread - PAGING-based read a region memory */
@@ -438,7 +638,7 @@ int libread(
     uint32_t offset,    // Source address = [source] + [offset]
     uint32_t *destination)
 {
-  BYTE data;
+  BYTE data = 0;
   int val = __read(proc, 0, source, offset, &data);
   /* TODO update result of reading action*/
   // destination
@@ -447,6 +647,7 @@ int libread(
     *destination = (uint32_t)data;
   }
 #ifdef IODUMP
+  pthread_mutex_lock(&mmvm_lock);
   printf("================================================================\n");
   printf("===== PHYSICAL MEMORY AFTER READING =====\n");
   printf("read region=%d offset=%d value=%d\n", source, offset, data);
@@ -454,6 +655,7 @@ int libread(
   print_pgtbl(proc, 0, -1); // print max TBL
 #endif
   MEMPHY_dump(proc->mram);
+  pthread_mutex_unlock(&mmvm_lock);
 #endif
 
   return val;
@@ -472,12 +674,17 @@ int __write(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE value)
   struct vm_rg_struct *currg = get_symrg_byid(caller->mm, rgid);
   struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
 
-  if (currg == NULL || cur_vma == NULL) /* Invalid memory identify */
+  int ret;
+
+  if (currg == NULL || cur_vma == NULL || /* Invalid memory identify */
+      currg->rg_start >= currg->rg_end)  /* Region is not allocated */
     return -1;
 
-  pg_setval(caller->mm, currg->rg_start + offset, value, caller);
+  pthread_mutex_lock(&mmvm_lock);
+  ret = pg_setval(caller->mm, currg->rg_start + offset, value, caller);
+  pthread_mutex_unlock(&mmvm_lock);
 
-  return 0;
+  return ret;
 }
 
 /*libwrite - PAGING-based write a region memory */
@@ -488,6 +695,7 @@ int libwrite(
     uint32_t offset)
 {
 #ifdef IODUMP
+  pthread_mutex_lock(&mmvm_lock);
   printf("================================================================\n");
   printf("===== PHYSICAL MEMORY AFTER WRITING =====\n");
   printf("write region=%d offset=%d value=%d\n", destination, offset, data);
@@ -495,6 +703,7 @@ int libwrite(
   print_pgtbl(proc, 0, -1); // print max TBL
 #endif
   MEMPHY_dump(proc->mram);
+  pthread_mutex_unlock(&mmvm_lock);
 #endif
 
   return __write(proc, 0, destination, offset, data);
@@ -502,68 +711,57 @@ int libwrite(
 
 /*free_pcb_memphy - collect all memphy of pcb
  *@caller: caller
- *@vmaid: ID vm area to alloc memory region
- *@incpgnum: number of page
+ *
+ * Give back the frames and swap slots of an exiting process and free its
+ * address space, caller->mm is no longer valid afterwards.
  */
 int free_pcb_memph(struct pcb_t *caller) // Thu hồi toàn bộ frame vật lý của tiến trình khi kết thúc
 {
-  int pagenum, fpn;
-  uint32_t pte;
-
-  for (pagenum = 0; pagenum < PAGING_MAX_PGN; pagenum++)
-  {
-    pte = caller->mm->pgd[pagenum];
-
-    if (!PAGING_PAGE_PRESENT(pte))
-    {
-      fpn = PAGING_PTE_FPN(pte);
-      MEMPHY_put_freefp(caller->mram, fpn);
-    }
-    else
-    {
-      fpn = PAGING_PTE_SWP(pte);
-      MEMPHY_put_freefp(caller->active_mswp, fpn);
-    }
-  }
+  pthread_mutex_lock(&mmvm_lock);
+  exit_mm(caller->mm, caller);
+  caller->mm = NULL;
+  pthread_mutex_unlock(&mmvm_lock);
 
   return 0;
 }
 
 /*find_victim_page - find victim page
- *@caller: caller
+ *@mm: address space
+ *@mram: MEMRAM device
  *@pgn: return page number
  *
  */
-int find_victim_page(struct mm_struct *mm, int *retpgn) // Chọn trang cần thay thế khi RAM đầy
+int find_victim_page(struct mm_struct *mm, struct memphy_struct *mram, int *retpgn)
 {
-  struct pgn_t *pg = mm->fifo_pgn;
+  struct pgn_t *pg, *prev = NULL;
+  struct pgn_t *vic = NULL, *vicprev = NULL;
+  uint32_t pte;
 
-  /* TODO: Implement the theorical mechanism to find the victim page */
-  // FIFO: First In First Out
-  if (pg == NULL)
+  /* FIFO: the list head is the newest page, take the oldest one that is
+   * not pinned by being mapped by another mm as well */
+  for (pg = mm->fifo_pgn; pg != NULL; prev = pg, pg = pg->pg_next)
   {
-    return -1;
+    pte = mm->pgd[pg->pgn];
+    if (PAGING_PAGE_PRESENT(pte) && !(pte & PAGING_PTE_SHARED_MASK) &&
+        MEMPHY_frame_refcnt(mram, PAGING_FPN(pte)) == 1)
+    {
+      vic = pg;
+      vicprev = prev;
+    }
   }
 
-  // Special case: only one node in list
-  if (pg->pg_next == NULL)
+  if (vic == NULL)
   {
-    *retpgn = pg->pgn;
-    free(pg);
-    mm->fifo_pgn = NULL;
-    return 0;
+    return -1;
   }
 
-  // Normal case: more than one node in list
-  while (pg->pg_next->pg_next != NULL)
-  {
-    pg = pg->pg_next;
-  }
+  if (vicprev == NULL)
+    mm->fifo_pgn = vic->pg_next;
+  else
+    vicprev->pg_next = vic->pg_next;
 
-  // pg now points to second last, remove last
-  *retpgn = pg->pg_next->pgn;
-  free(pg->pg_next);
-  pg->pg_next = NULL;
+  *retpgn = vic->pgn;
+  free(vic);
 
   return 0;
 }
@@ -572,40 +770,51 @@ int find_victim_page(struct mm_struct *mm, int *retpgn) // Chọn trang cần th
  *@caller: caller
  *@vmaid: ID vm area to alloc memory region
  *@size: allocated size
+ *@newrg: returned region [rg_start, rg_end)
  *
+ * Segregated fit: first fit inside the request's own size class, otherwise
+ * the first non-empty larger class, whose regions are all big enough.
  */
 int get_free_vmrg_area(struct pcb_t *caller, int vmaid, int size, struct vm_rg_struct *newrg)
 {
   struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
-  if (cur_vma == NULL) return -1;
+  struct vm_rg_struct *rgit;
+  unsigned long bigger;
+  int bin;
 
-  // struct vm_rg_struct *rgit = cur_vma->vm_freerg_list;
-  struct vm_rg_struct *prev = NULL;
-  struct vm_rg_struct *curr = cur_vma->vm_freerg_list;
-  while (curr != NULL) {
-    unsigned long freesize = curr->rg_end - curr->rg_start + 1;
-    if(freesize < size || curr->rg_start > curr->rg_end) {
+  if (cur_vma == NULL || size <= 0)
+    return -1;
+
+  bin = freerg_bin_idx(size);
+  rgit = cur_vma->vm_freerg_bins[bin];
+  while (rgit != NULL && rgit->rg_end - rgit->rg_start < size)
+    rgit = rgit->rg_bin_next;
+
+  if (rgit == NULL)
+  {
+    bigger = cur_vma->vm_freerg_binmap & ~(BIT_MASK(bin + 1) - 1);
+    if (bin + 1 >= PAGING_FREERG_NBINS || bigger == 0)
       return -1;
-    }
-    if (freesize >= size) {
-      newrg->rg_start = curr->rg_start;
-      newrg->rg_end   = curr->rg_start + size - 1;
-      // Update current region: if there is remaining space, adjust rg_start
-      if (freesize > size) {
-        curr->rg_start += size;
-      } else {
-        if (prev == NULL) {
-          cur_vma->vm_freerg_list = curr->rg_next;
-        } else {
-          prev->rg_next = curr->rg_next;
-        }
-        free(curr);
-      }
-      return 0;
-    }
-    prev = curr;
-    curr = curr->rg_next;
+    rgit = cur_vma->vm_freerg_bins[__builtin_ctzl(bigger)];
   }
-  return -1;
+
+  newrg->rg_start = rgit->rg_start;
+  newrg->rg_end = rgit->rg_start + size;
+  newrg->rg_next = NULL;
+
+  /* Carve the request from the bottom, the rest changes size class */
+  freerg_bin_remove(cur_vma, rgit);
+  rgit->rg_start += size;
+  if (rgit->rg_start == rgit->rg_end)
+  {
+    freerg_unlink(cur_vma, rgit);
+    free(rgit);
+  }
+  else
+  {
+    freerg_bin_insert(cur_vma, rgit);
+  }
+
+  return 0;
 }
 // #endif
\ No newline at end of file
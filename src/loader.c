@@ -3,8 +3,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 static uint32_t avail_pid = 1;
+static pthread_mutex_t pid_lock = PTHREAD_MUTEX_INITIALIZER;
 
 #define OPT_CALC	"calc"
 #define OPT_ALLOC	"alloc"
@@ -32,15 +34,27 @@ static enum ins_opcode_t get_opcode(char * opt) {
 	}
 }
 
+uint32_t alloc_pid(void) {
+	uint32_t pid;
+	/* Processes are also created by fork on the CPU threads */
+	pthread_mutex_lock(&pid_lock);
+	pid = avail_pid++;
+	pthread_mutex_unlock(&pid_lock);
+	return pid;
+}
+
 struct pcb_t * load(const char * path) {
 	/* Create new PCB for the new process */
 	struct pcb_t * proc = (struct pcb_t * )malloc(sizeof(struct pcb_t));
-	proc->pid = avail_pid;
-	avail_pid++;
+	proc->pid = alloc_pid();
 	proc->page_table =
 		(struct page_table_t*)malloc(sizeof(struct page_table_t));
 	proc->bp = PAGE_SIZE;
 	proc->pc = 0;
+	proc->cpu = 0;
+	proc->affinity = ~0U;
+	proc->regs = NULL;
+	proc->nregs = 0;
 
 	/* Read process code from file */
 	FILE * file;
@@ -52,8 +66,9 @@ struct pcb_t * load(const char * path) {
 	char opcode[10];
 	proc->code = (struct code_seg_t*)malloc(sizeof(struct code_seg_t));
 	fscanf(file, "%u %u", &proc->priority, &proc->code->size);
-	proc->code->text = (struct inst_t*)malloc(
-		sizeof(struct inst_t) * proc->code->size
+	/* Arguments left out of a syscall line read as 0 */
+	proc->code->text = (struct inst_t*)calloc(
+		proc->code->size, sizeof(struct inst_t)
 	);
 	uint32_t i = 0;
 	char buf[200];
@@ -98,8 +113,17 @@ struct pcb_t * load(const char * path) {
 			exit(1);
 		}
 	}
+	fclose(file);
 	return proc;
 }
 
+void free_pcb(struct pcb_t * proc) {
+	free(proc->code->text);
+	free(proc->code);
+	free(proc->regs);
+	free(proc->page_table);
+	free(proc);
+}
+
 
 
@@ -0,0 +1,242 @@
+// #ifdef MM_PAGING
+/*
+ * PAGING based Memory Management
+ * Same page merging mm/mm-ksm.c
+ *
+ * A scanner walks the VM areas of every live mm a few pages at a time,
+ * hashing the resident frames into a table rebuilt on each full pass. A page
+ * whose content equals an already seen page is remapped onto that page's
+ * frame and both are write protected with PAGING_PTE_COW_MASK, so the
+ * duplicate frame goes back to the free list and a later write breaks
+ * the sharing through do_cow_page().
+ */
+
+#include "mm.h"
+#include "libmem.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+#define KSM_HASH_BITS 10
+#define KSM_HASH_SZ BIT(KSM_HASH_BITS)
+
+/* A page seen during the current pass */
+struct ksm_node
+{
+  uint32_t hash;
+  struct mm_struct *mm;
+  int pgn;
+  int fpn;
+  struct ksm_node *next;
+};
+
+static struct ksm_node *ksm_tbl[KSM_HASH_SZ];
+
+/* Scan cursor, kept across calls */
+static struct mm_struct *ksm_mm = NULL;
+static int ksm_pgn = 0;
+
+static struct
+{
+  unsigned long scanned;  /* resident pages hashed */
+  unsigned long merged;   /* pages remapped onto an identical frame */
+  unsigned long unmerged; /* ... copied off it again by a write */
+  unsigned long passes;   /* full walks of all mms */
+} ksm_stat;
+
+/* FNV-1a over the frame content */
+static uint32_t ksm_hash_page(struct memphy_struct *mram, int fpn)
+{
+  uint32_t hash = 2166136261U;
+  int cellidx;
+  BYTE data;
+
+  for (cellidx = 0; cellidx < PAGING_PAGESZ; cellidx++)
+  {
+    MEMPHY_read(mram, fpn * PAGING_PAGESZ + cellidx, &data);
+    hash = (hash ^ data) * 16777619U;
+  }
+
+  return hash;
+}
+
+static int ksm_same_page(struct memphy_struct *mram, int fpn1, int fpn2)
+{
+  int cellidx;
+  BYTE d1, d2;
+
+  for (cellidx = 0; cellidx < PAGING_PAGESZ; cellidx++)
+  {
+    MEMPHY_read(mram, fpn1 * PAGING_PAGESZ + cellidx, &d1);
+    MEMPHY_read(mram, fpn2 * PAGING_PAGESZ + cellidx, &d2);
+    if (d1 != d2)
+      return 0;
+  }
+
+  return 1;
+}
+
+/* Forget the pages of the previous pass */
+static void ksm_reset(void)
+{
+  struct ksm_node *node;
+  int i;
+
+  for (i = 0; i < KSM_HASH_SZ; i++)
+    while (ksm_tbl[i] != NULL)
+    {
+      node = ksm_tbl[i];
+      ksm_tbl[i] = node->next;
+      free(node);
+    }
+}
+
+/* Nodes may be stale, only merge with a page still mapped as recorded */
+static int ksm_node_valid(struct ksm_node *node)
+{
+  uint32_t pte;
+
+  if (!mm_is_registered(node->mm))
+    return 0;
+
+  pte = node->mm->pgd[node->pgn];
+  return PAGING_PAGE_PRESENT(pte) && !(pte & PAGING_PTE_SHARED_MASK) &&
+         PAGING_FPN(pte) == node->fpn;
+}
+
+static void ksm_scan_page(struct memphy_struct *mram, struct mm_struct *mm, int pgn)
+{
+  uint32_t *pte = &mm->pgd[pgn];
+  struct ksm_node *node;
+  uint32_t hash;
+  int fpn;
+
+  /* Shared memory pages are meant to be written in place */
+  if (!PAGING_PAGE_PRESENT(*pte) || (*pte & PAGING_PTE_SHARED_MASK))
+    return;
+
+  fpn = PAGING_FPN(*pte);
+
+  /* Unshared since it was merged or forked, no longer write protected */
+  if ((*pte & PAGING_PTE_COW_MASK) && MEMPHY_frame_refcnt(mram, fpn) == 1)
+  {
+    CLRBIT(*pte, PAGING_PTE_COW_MASK);
+    MEMPHY_set_owner(mram, fpn, mm, pgn);
+  }
+
+  hash = ksm_hash_page(mram, fpn);
+  ksm_stat.scanned++;
+
+  for (node = ksm_tbl[hash & (KSM_HASH_SZ - 1)]; node != NULL; node = node->next)
+  {
+    if (node->hash != hash || !ksm_node_valid(node))
+      continue;
+    if (node->fpn == fpn)
+      return; /* already sharing the frame */
+    if (!ksm_same_page(mram, node->fpn, fpn))
+      continue;
+
+    SETBIT(node->mm->pgd[node->pgn], PAGING_PTE_COW_MASK);
+    MEMPHY_ref_frame(mram, node->fpn);
+    mram->frmtbl[node->fpn].flags |= FRAME_MERGED;
+    pte_set_fpn(pte, node->fpn);
+    SETBIT(*pte, PAGING_PTE_COW_MASK);
+    ksm_stat.merged++;
+    /* The page was shared copy-on-write, its other mapping keeps it */
+    if (MEMPHY_unref_frame(mram, fpn) == 1)
+      __cow_last_mapping(mram, fpn);
+    return;
+  }
+
+  node = malloc(sizeof(struct ksm_node));
+  node->hash = hash;
+  node->mm = mm;
+  node->pgn = pgn;
+  node->fpn = fpn;
+  node->next = ksm_tbl[hash & (KSM_HASH_SZ - 1)];
+  ksm_tbl[hash & (KSM_HASH_SZ - 1)] = node;
+}
+
+/*
+ * ksm_cow_copy - a write copied a page off a shared frame
+ * @mram : MEMRAM device
+ * @fpn  : frame the page was copied from
+ *
+ * A copy off a merged frame undoes a merge. Call with mmvm_lock held.
+ */
+void ksm_cow_copy(struct memphy_struct *mram, int fpn)
+{
+  if (mram->frmtbl[fpn].flags & FRAME_MERGED)
+    ksm_stat.unmerged++;
+}
+
+/*
+ * ksm_scan - scan the next pages of the VM areas for duplicates
+ * @mram   : MEMRAM device
+ * @npages : number of pages to look at, resident or not
+ *
+ * Only the pages inside VM areas are visited and each one counts, so a
+ * call holds the locks for at most npages PTEs plus the areas it steps
+ * over. The walk stops early once it completes a pass, so an idle
+ * system does not spin over empty page tables.
+ */
+int ksm_scan(struct memphy_struct *mram, int npages)
+{
+  struct vm_area_struct *vma;
+  int pgn_end;
+
+  pthread_mutex_lock(&mmvm_lock);
+  pthread_mutex_lock(&mm_list_lock);
+
+  if (ksm_mm == NULL || !mm_is_registered(ksm_mm))
+  {
+    ksm_mm = mm_list;
+    ksm_pgn = 0;
+  }
+
+  while (ksm_mm != NULL && npages > 0)
+  {
+    /* First private area not yet behind the cursor */
+    for (vma = ksm_mm->mmap; vma != NULL; vma = vma->vm_next)
+      if (!(vma->vm_flags & VM_SHARED) && DIV_ROUND_UP(vma->vm_end, PAGING_PAGESZ) > ksm_pgn)
+        break;
+
+    if (vma == NULL)
+    {
+      ksm_mm = ksm_mm->mm_next;
+      ksm_pgn = 0;
+      if (ksm_mm == NULL)
+      {
+        ksm_stat.passes++;
+        ksm_reset();
+        break;
+      }
+      continue;
+    }
+
+    if (ksm_pgn < PAGING_PGN(vma->vm_start))
+      ksm_pgn = PAGING_PGN(vma->vm_start);
+    pgn_end = DIV_ROUND_UP(vma->vm_end, PAGING_PAGESZ);
+    for (; ksm_pgn < pgn_end && npages > 0; ksm_pgn++, npages--)
+      if (PAGING_PAGE_PRESENT(ksm_mm->pgd[ksm_pgn]))
+        ksm_scan_page(mram, ksm_mm, ksm_pgn);
+  }
+
+  pthread_mutex_unlock(&mm_list_lock);
+  pthread_mutex_unlock(&mmvm_lock);
+
+  return 0;
+}
+
+int print_ksm_stat(void)
+{
+  if (ksm_stat.scanned == 0)
+    return 0;
+
+  /* Merges a copy-on-write copy has not undone yet */
+  printf("ksm: scanned %lu pages in %lu passes, merged %lu, unmerged by writes %lu, frames saved %lu\n",
+         ksm_stat.scanned, ksm_stat.passes, ksm_stat.merged, ksm_stat.unmerged,
+         ksm_stat.merged - ksm_stat.unmerged);
+  return 0;
+}
+
+// #endif
@@ -114,6 +114,44 @@ int MEMPHY_write(struct memphy_struct *mp, int addr, BYTE data)
    return 0;
 }
 
+/*
+ *  MEMPHY_build_free_lists - put every frame on the free list of its node
+ *  @mp: memphy struct
+ *  @numfp: number of frames
+ *
+ *  Node i holds the FPNs [i * numfp / nnodes, (i + 1) * numfp / nnodes),
+ *  each list is kept in FPN order.
+ */
+static void MEMPHY_build_free_lists(struct memphy_struct *mp, int numfp)
+{
+   struct framephy_struct *fst;
+   int iter, nid;
+
+   for (nid = 0; nid < MEMPHY_MAX_NODES; nid++)
+   {
+      while (mp->free_fp_list[nid] != NULL)
+      {
+         fst = mp->free_fp_list[nid];
+         mp->free_fp_list[nid] = fst->fp_next;
+         free(fst);
+      }
+      mp->node_free_cnt[nid] = 0;
+   }
+
+   for (iter = numfp - 1; iter >= 0; iter--)
+   {
+      nid = (int)((long)iter * mp->nnodes / numfp);
+      mp->frmtbl[iter].nid = nid;
+
+      fst = malloc(sizeof(struct framephy_struct));
+      fst->fpn = iter;
+      fst->fp_next = mp->free_fp_list[nid];
+      mp->free_fp_list[nid] = fst;
+      mp->node_free_cnt[nid]++;
+   }
+   mp->free_fp_cnt = numfp;
+}
+
 /*
  *  MEMPHY_format-format MEMPHY device
  *  @mp: memphy struct
@@ -122,39 +160,54 @@ int MEMPHY_format(struct memphy_struct *mp, int pagesz)
 {
    /* This setting come with fixed constant PAGESZ */
    int numfp = mp->maxsz / pagesz;
-   struct framephy_struct *newfst, *fst;
-   int iter = 0;
 
    if (numfp <= 0)
       return -1;
 
-   /* Init head of free framephy list */
-   fst = malloc(sizeof(struct framephy_struct));
-   fst->fpn = iter;
-   mp->free_fp_list = fst;
+   MEMPHY_build_free_lists(mp, numfp);
 
-   /* We have list with first element, fill in the rest num-1 element member*/
-   for (iter = 1; iter < numfp; iter++)
-   {
-      newfst = malloc(sizeof(struct framephy_struct));
-      newfst->fpn = iter;
-      newfst->fp_next = NULL;
-      fst->fp_next = newfst;
-      fst = newfst;
-   }
+   return 0;
+}
+
+/*
+ *  MEMPHY_set_nodes - split the frames of an unused device into memory nodes
+ *  @mp: memphy struct
+ *  @nnodes: number of nodes
+ */
+int MEMPHY_set_nodes(struct memphy_struct *mp, int nnodes)
+{
+   if (nnodes < 1 || nnodes > MEMPHY_MAX_NODES || nnodes > mp->maxfpn ||
+       mp->free_fp_cnt != mp->maxfpn)
+      return -1;
+
+   mp->nnodes = nnodes;
+   MEMPHY_build_free_lists(mp, mp->maxfpn);
 
    return 0;
 }
 
-int MEMPHY_get_freefp(struct memphy_struct *mp, int *retfpn)
+/*
+ *  MEMPHY_get_freefp_node - take a free frame of one memory node
+ *  @mp: memphy struct
+ *  @nid: node
+ *  @retfpn: returned frame
+ */
+int MEMPHY_get_freefp_node(struct memphy_struct *mp, int nid, int *retfpn)
 {
-   struct framephy_struct *fp = mp->free_fp_list;
+   struct framephy_struct *fp;
 
+   if (nid < 0 || nid >= mp->nnodes)
+      return -1;
+
+   fp = mp->free_fp_list[nid];
    if (fp == NULL)
       return -1;
 
    *retfpn = fp->fpn;
-   mp->free_fp_list = fp->fp_next;
+   mp->free_fp_list[nid] = fp->fp_next;
+   mp->node_free_cnt[nid]--;
+   mp->free_fp_cnt--;
+   mp->frmtbl[fp->fpn].refcnt = 1;
 
    /* MEMPHY is iteratively used up until its exhausted
     * No garbage collector acting then it not been released
@@ -164,6 +217,69 @@ int MEMPHY_get_freefp(struct memphy_struct *mp, int *retfpn)
    return 0;
 }
 
+/*
+ *  MEMPHY_get_freefp - take a free frame of the node with most of them
+ *  @mp: memphy struct
+ *  @retfpn: returned frame
+ */
+int MEMPHY_get_freefp(struct memphy_struct *mp, int *retfpn)
+{
+   int nid, best = 0;
+
+   for (nid = 1; nid < mp->nnodes; nid++)
+      if (mp->node_free_cnt[nid] > mp->node_free_cnt[best])
+         best = nid;
+
+   return MEMPHY_get_freefp_node(mp, best, retfpn);
+}
+
+/*
+ *  MEMPHY_get_freefp_range - take a run of contiguous free frames
+ *  @mp: memphy struct
+ *  @num: number of frames
+ *  @retfpn: first frame of the run
+ */
+int MEMPHY_get_freefp_range(struct memphy_struct *mp, int num, int *retfpn)
+{
+   struct framephy_struct **pp, *fp;
+   int fpn, start, nid, run = 0;
+
+   if (num <= 0 || mp->free_fp_cnt < num)
+      return -1;
+
+   for (fpn = 0; fpn < mp->maxfpn && run < num; fpn++)
+      run = (mp->frmtbl[fpn].refcnt == 0) ? run + 1 : 0;
+
+   if (run < num)
+      return -1;
+   start = fpn - num;
+
+   /* Unlink the whole run from the free lists in one walk each */
+   for (nid = 0; nid < mp->nnodes; nid++)
+   {
+      pp = &mp->free_fp_list[nid];
+      while (*pp != NULL)
+      {
+         fp = *pp;
+         if (fp->fpn >= start && fp->fpn < start + num)
+         {
+            *pp = fp->fp_next;
+            mp->node_free_cnt[nid]--;
+            free(fp);
+         }
+         else
+            pp = &fp->fp_next;
+      }
+   }
+
+   for (fpn = start; fpn < start + num; fpn++)
+      mp->frmtbl[fpn].refcnt = 1;
+   mp->free_fp_cnt -= num;
+
+   *retfpn = start;
+   return 0;
+}
+
 int MEMPHY_dump(struct memphy_struct *mp)
 {
   /*TODO dump memphy contnt mp->storage
@@ -180,13 +296,187 @@ int MEMPHY_dump(struct memphy_struct *mp)
 
 int MEMPHY_put_freefp(struct memphy_struct *mp, int fpn)
 {
-   struct framephy_struct *fp = mp->free_fp_list;
+   int nid = mp->frmtbl[fpn].nid;
+   struct framephy_struct *fp = mp->free_fp_list[nid];
    struct framephy_struct *newnode = malloc(sizeof(struct framephy_struct));
 
    /* Create new node with value fpn */
    newnode->fpn = fpn;
    newnode->fp_next = fp;
-   mp->free_fp_list = newnode;
+   mp->free_fp_list[nid] = newnode;
+   mp->node_free_cnt[nid]++;
+   mp->free_fp_cnt++;
+   mp->frmtbl[fpn].refcnt = 0;
+   mp->frmtbl[fpn].flags = 0;
+   MEMPHY_clear_owner(mp, fpn);
+   mp->frmtbl[fpn].acc_cnt = 0;
+
+   /* Its content is dead, so is the swap slot kept for it */
+   MEMPHY_drop_swpcache(mp, fpn);
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_ref_frame - add a mapping to a used frame
+ *  @mp: memphy struct
+ *  @fpn: frame number
+ */
+int MEMPHY_ref_frame(struct memphy_struct *mp, int fpn)
+{
+   if (fpn < 0 || fpn >= mp->maxfpn || mp->frmtbl[fpn].refcnt <= 0)
+      return -1;
+
+   return ++mp->frmtbl[fpn].refcnt;
+}
+
+/*
+ *  MEMPHY_unref_frame - drop a mapping, the last one frees the frame
+ *  @mp: memphy struct
+ *  @fpn: frame number
+ *  Return the remaining number of mappings
+ */
+int MEMPHY_unref_frame(struct memphy_struct *mp, int fpn)
+{
+   if (fpn < 0 || fpn >= mp->maxfpn || mp->frmtbl[fpn].refcnt <= 0)
+      return -1;
+
+   if (--mp->frmtbl[fpn].refcnt == 0)
+      MEMPHY_put_freefp(mp, fpn);
+
+   return mp->frmtbl[fpn].refcnt;
+}
+
+/*
+ *  MEMPHY_frame_refcnt - number of mappings of a frame
+ *  @mp: memphy struct
+ *  @fpn: frame number
+ */
+int MEMPHY_frame_refcnt(struct memphy_struct *mp, int fpn)
+{
+   if (fpn < 0 || fpn >= mp->maxfpn)
+      return -1;
+
+   return mp->frmtbl[fpn].refcnt;
+}
+
+/*
+ *  MEMPHY_set_owner - record the PTE mapping a frame
+ *  @mp: memphy struct
+ *  @fpn: frame number
+ *  @mm: address space of the mapping
+ *  @pgn: page number of the mapping
+ */
+int MEMPHY_set_owner(struct memphy_struct *mp, int fpn, struct mm_struct *mm, int pgn)
+{
+   struct framedesc_struct *fd;
+
+   if (fpn < 0 || fpn >= mp->maxfpn)
+      return -1;
+
+   fd = &mp->frmtbl[fpn];
+   if (fd->owner != mm)
+   {
+      /* Move the frame to the owned list of mm */
+      MEMPHY_clear_owner(mp, fpn);
+      fd->owner = mm;
+      fd->own_prev = -1;
+      fd->own_next = mm->owned_fpn;
+      if (mm->owned_fpn >= 0)
+         mp->frmtbl[mm->owned_fpn].own_prev = fpn;
+      mm->owned_fpn = fpn;
+   }
+   fd->pgn = pgn;
+   fd->flags |= FRAME_REFERENCED;
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_clear_owner - forget the PTE mapping a frame
+ *  @mp: memphy struct
+ *  @fpn: frame number
+ *  The frame leaves the owned list of its owner.
+ */
+int MEMPHY_clear_owner(struct memphy_struct *mp, int fpn)
+{
+   struct framedesc_struct *fd;
+
+   if (fpn < 0 || fpn >= mp->maxfpn)
+      return -1;
+
+   fd = &mp->frmtbl[fpn];
+   if (fd->owner == NULL)
+      return 0;
+
+   if (fd->own_prev >= 0)
+      mp->frmtbl[fd->own_prev].own_next = fd->own_next;
+   else
+      fd->owner->owned_fpn = fd->own_next;
+   if (fd->own_next >= 0)
+      mp->frmtbl[fd->own_next].own_prev = fd->own_prev;
+   fd->owner = NULL;
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_set_swpcache - remember that a frame equals a swap slot
+ *  @mp: memphy struct
+ *  @fpn: frame number
+ *  @swpdev: swap device, the frame takes over one reference of the slot
+ *  @swptyp: swap device id
+ *  @swpoff: swap slot
+ */
+int MEMPHY_set_swpcache(struct memphy_struct *mp, int fpn,
+                        struct memphy_struct *swpdev, int swptyp, int swpoff)
+{
+   if (fpn < 0 || fpn >= mp->maxfpn)
+      return -1;
+
+   MEMPHY_drop_swpcache(mp, fpn);
+   mp->frmtbl[fpn].swpdev = swpdev;
+   mp->frmtbl[fpn].swptyp = swptyp;
+   mp->frmtbl[fpn].swpoff = swpoff;
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_take_swpcache - hand the cached swap slot of a frame back to a
+ *                         swap entry, the reference goes with it
+ *  @mp: memphy struct
+ *  @fpn: frame number
+ *  @swptyp: returned swap device id
+ *  @swpoff: returned swap slot
+ */
+int MEMPHY_take_swpcache(struct memphy_struct *mp, int fpn, int *swptyp, int *swpoff)
+{
+   if (fpn < 0 || fpn >= mp->maxfpn || mp->frmtbl[fpn].swpdev == NULL)
+      return -1;
+
+   *swptyp = mp->frmtbl[fpn].swptyp;
+   *swpoff = mp->frmtbl[fpn].swpoff;
+   mp->frmtbl[fpn].swpdev = NULL;
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_drop_swpcache - forget the cached swap slot of a frame
+ *  @mp: memphy struct
+ *  @fpn: frame number
+ */
+int MEMPHY_drop_swpcache(struct memphy_struct *mp, int fpn)
+{
+   struct memphy_struct *swpdev;
+
+   if (fpn < 0 || fpn >= mp->maxfpn || mp->frmtbl[fpn].swpdev == NULL)
+      return -1;
+
+   swpdev = mp->frmtbl[fpn].swpdev;
+   mp->frmtbl[fpn].swpdev = NULL;
+   MEMPHY_unref_frame(swpdev, mp->frmtbl[fpn].swpoff);
 
    return 0;
 }
@@ -200,6 +490,16 @@ int init_memphy(struct memphy_struct *mp, int max_size, int randomflg)
    mp->maxsz = max_size;
    memset(mp->storage, 0, max_size * sizeof(BYTE));
 
+   mp->maxfpn = max_size / PAGING_PAGESZ;
+   mp->frmtbl = calloc(mp->maxfpn + 1, sizeof(struct framedesc_struct));
+
+   /* An unused device (size 0) keeps empty lists */
+   memset(mp->free_fp_list, 0, sizeof(mp->free_fp_list));
+   memset(mp->node_free_cnt, 0, sizeof(mp->node_free_cnt));
+   mp->used_fp_list = NULL;
+   mp->free_fp_cnt = 0;
+   mp->nnodes = 1;
+
    MEMPHY_format(mp, PAGING_PAGESZ);
 
    mp->rdmflg = (randomflg != 0) ? 1 : 0;
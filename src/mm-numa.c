@@ -0,0 +1,181 @@
+// #ifdef MM_PAGING
+/*
+ * PAGING based Memory Management
+ * Memory nodes mm/mm-numa.c
+ *
+ * MEMRAM is split into nodes of contiguous frames, CPUs are split into as
+ * many groups of consecutive ids, group i being local to node i. Frames
+ * are allocated on the node of the CPU the process runs on, other nodes
+ * only serve when it has no free frame left. An access to a frame of
+ * another node costs remote_cost simulated cycles instead of one, and a
+ * private page accessed NUMA_MIGRATE_RUN times in a row from the same
+ * remote node is moved to a free frame of that node.
+ */
+
+#include "mm.h"
+#include <stdio.h>
+
+#define NUMA_MIGRATE_RUN 4
+
+static struct memphy_struct *numa_mram = NULL;
+static int numa_nnodes = 1;
+static int numa_ncpus = 1;
+static int numa_remote_cost = 1;
+
+static struct
+{
+  unsigned long alloc_local;    /* frames taken on the CPU's node */
+  unsigned long alloc_fallback; /* ... on another node, the local one full */
+  unsigned long acc_local;
+  unsigned long acc_remote;
+  unsigned long cycles;         /* simulated access latency */
+  unsigned long migrated;       /* pages moved to the accessing node */
+} numa_stat;
+
+/*
+ * numa_init - split MEMRAM and the CPUs into memory nodes
+ * @mram        : MEMRAM device, not used yet
+ * @nnodes      : number of nodes
+ * @ncpus       : number of CPUs
+ * @remote_cost : cycles of an access to a remote node, a local one is 1
+ */
+int numa_init(struct memphy_struct *mram, int nnodes, int ncpus, int remote_cost)
+{
+  if (ncpus < 1 || remote_cost < 1 || MEMPHY_set_nodes(mram, nnodes) < 0)
+    return -1;
+
+  numa_mram = mram;
+  numa_nnodes = nnodes;
+  numa_ncpus = ncpus;
+  numa_remote_cost = remote_cost;
+  return 0;
+}
+
+/*
+ * numa_cpu_node - node local to a CPU
+ * @cpu : CPU id
+ */
+int numa_cpu_node(int cpu)
+{
+  if (cpu < 0 || cpu >= numa_ncpus)
+    return 0;
+
+  return (int)((long)cpu * numa_nnodes / numa_ncpus);
+}
+
+/*
+ * numa_alloc_frame - take a free MEMRAM frame, local to the caller's CPU
+ *                    when one is left
+ * @caller : caller
+ * @retfpn : returned frame
+ */
+int numa_alloc_frame(struct pcb_t *caller, int *retfpn)
+{
+  if (numa_nnodes <= 1)
+    return MEMPHY_get_freefp(caller->mram, retfpn);
+
+  if (MEMPHY_get_freefp_node(caller->mram, numa_cpu_node(caller->cpu), retfpn) == 0)
+  {
+    numa_stat.alloc_local++;
+    return 0;
+  }
+
+  if (MEMPHY_get_freefp(caller->mram, retfpn) < 0)
+    return -1;
+
+  numa_stat.alloc_fallback++;
+  return 0;
+}
+
+/* Move a private page to a free frame of node nid, never evicting */
+static int numa_migrate_page(struct pcb_t *caller, int pgn, int fpn, int nid, int *retfpn)
+{
+  struct memphy_struct *mram = caller->mram;
+  struct memphy_struct *mswp = (struct memphy_struct *)caller->mswp;
+  uint32_t *pte = &caller->mm->pgd[pgn];
+  int newfpn, swptyp, swpoff;
+
+  if (MEMPHY_frame_refcnt(mram, fpn) != 1 ||
+      (*pte & (PAGING_PTE_COW_MASK | PAGING_PTE_SHARED_MASK)))
+    return -1;
+
+  if (MEMPHY_get_freefp_node(mram, nid, &newfpn) < 0)
+    return -1;
+
+  __swap_cp_page(mram, fpn, mram, newfpn);
+
+  /* The swap cache follows the data */
+  if (MEMPHY_take_swpcache(mram, fpn, &swptyp, &swpoff) == 0)
+    MEMPHY_set_swpcache(mram, newfpn, mswp + swptyp, swptyp, swpoff);
+
+  pte_set_fpn(pte, newfpn);
+  MEMPHY_set_owner(mram, newfpn, caller->mm, pgn);
+  MEMPHY_unref_frame(mram, fpn);
+
+  numa_stat.migrated++;
+  *retfpn = newfpn;
+  return 0;
+}
+
+/*
+ * numa_access - account an access to a resident page, migrating it
+ *               toward the accessing node when it keeps being remote
+ * @caller : caller
+ * @pgn    : page number
+ * @fpn    : frame of the page, updated when the page moves
+ */
+int numa_access(struct pcb_t *caller, int pgn, int *fpn)
+{
+  struct framedesc_struct *fd;
+  int nid;
+
+  if (numa_nnodes <= 1)
+    return 0;
+
+  fd = &caller->mram->frmtbl[*fpn];
+  nid = numa_cpu_node(caller->cpu);
+
+  if (fd->nid == nid)
+  {
+    numa_stat.acc_local++;
+    numa_stat.cycles++;
+    fd->acc_cnt = 0;
+    return 0;
+  }
+
+  numa_stat.acc_remote++;
+  numa_stat.cycles += numa_remote_cost;
+
+  if (fd->acc_cnt > 0 && fd->acc_nid == nid)
+    fd->acc_cnt++;
+  else
+  {
+    fd->acc_nid = nid;
+    fd->acc_cnt = 1;
+  }
+
+  if (fd->acc_cnt >= NUMA_MIGRATE_RUN)
+    numa_migrate_page(caller, pgn, *fpn, nid, fpn);
+
+  return 0;
+}
+
+int print_numa_stat(void)
+{
+  unsigned long nacc = numa_stat.acc_local + numa_stat.acc_remote;
+  int nid;
+
+  if (numa_nnodes <= 1)
+    return 0;
+
+  for (nid = 0; nid < numa_nnodes; nid++)
+    printf("numa node %d: %d free frames\n", nid, numa_mram->node_free_cnt[nid]);
+  printf("numa: allocated %lu local, %lu on another node\n",
+         numa_stat.alloc_local, numa_stat.alloc_fallback);
+  printf("numa: %lu local and %lu remote accesses, avg latency %.2f cycles, %lu pages migrated\n",
+         numa_stat.acc_local, numa_stat.acc_remote,
+         nacc ? (double)numa_stat.cycles / nacc : 0.0, numa_stat.migrated);
+  return 0;
+}
+
+// #endif
@@ -0,0 +1,214 @@
+// #ifdef MM_PAGING
+/*
+ * PAGING based Memory Management
+ * Shared memory module mm/mm-shm.c
+ */
+
+#include "mm.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+/*
+ * Shared memory segment, its frames are mapped in place by every process
+ * attaching it and stay in MEMRAM until the last one detaches
+ */
+struct shm_struct
+{
+  int key;
+  int size;
+  int npages;
+  int *fpns;
+  int nattch; /* mappings, a forked copy counts as one */
+  struct shm_struct *shm_next;
+};
+
+static struct shm_struct *shm_list = NULL;
+
+static struct shm_struct *shm_find(int key)
+{
+  struct shm_struct *shm;
+
+  for (shm = shm_list; shm != NULL; shm = shm->shm_next)
+    if (shm->key == key)
+      return shm;
+
+  return NULL;
+}
+
+/*
+ * shm_get - get the shared memory segment of a key, creating it if needed
+ * @caller : caller
+ * @key    : segment key
+ * @size   : segment size, only used on creation
+ */
+int shm_get(struct pcb_t *caller, int key, int size)
+{
+  struct shm_struct *shm = shm_find(key);
+  int pgit, fpn;
+
+  if (shm != NULL)
+    return 0;
+
+  if (size <= 0)
+    return -1;
+
+  shm = malloc(sizeof(struct shm_struct));
+  shm->key = key;
+  shm->size = size;
+  shm->npages = PAGING_PAGE_ALIGNSZ(size) / PAGING_PAGESZ;
+  shm->fpns = malloc(shm->npages * sizeof(int));
+  shm->nattch = 0;
+
+  /* The segment keeps the first reference of each frame */
+  for (pgit = 0; pgit < shm->npages; pgit++)
+  {
+    if (get_free_frame(caller, &fpn) < 0)
+    {
+      while (pgit-- > 0)
+        MEMPHY_unref_frame(caller->mram, shm->fpns[pgit]);
+      free(shm->fpns);
+      free(shm);
+      return -1;
+    }
+    __zero_fill_page(caller->mram, fpn);
+    shm->fpns[pgit] = fpn;
+  }
+
+  shm->shm_next = shm_list;
+  shm_list = shm;
+
+  return 0;
+}
+
+/*
+ * shm_attach - map a shared memory segment into the caller address space
+ * @caller : caller
+ * @key    : segment key
+ * @addr   : returned start address of the mapping
+ *
+ * The mapping gets its own VM area flagged VM_SHARED, its pages point to
+ * the frames of the segment: no data is copied. Return the segment size.
+ */
+int shm_attach(struct pcb_t *caller, int key, unsigned long *addr)
+{
+  struct shm_struct *shm = shm_find(key);
+  struct mm_struct *mm = caller->mm;
+  struct vm_area_struct *vma;
+  unsigned long len;
+  long start;
+  int pgit, pgn;
+
+  if (shm == NULL)
+    return -1;
+
+  len = (unsigned long)shm->npages * PAGING_PAGESZ;
+  start = get_unmapped_area(mm, len);
+  if (start < 0)
+    return -1;
+
+  vma = malloc(sizeof(struct vm_area_struct));
+  vma->vm_id = (mm->map_count > 0) ? mm->mmap_by_id[mm->map_count - 1]->vm_id + 1 : 0;
+  vma->vm_flags = VM_SHARED;
+  vma->vm_start = start;
+  vma->vm_end = start + len;
+  vma->sbrk = vma->vm_end;
+  vma->vm_freerg_list = NULL;
+  vma->vm_freerg_last = NULL;
+  for (pgit = 0; pgit < PAGING_FREERG_NBINS; pgit++)
+    vma->vm_freerg_bins[pgit] = NULL;
+  vma->vm_freerg_binmap = 0;
+  if (insert_vm_area(mm, vma) < 0)
+  {
+    free(vma);
+    return -1;
+  }
+
+  pgn = PAGING_PGN(start);
+  for (pgit = 0; pgit < shm->npages; pgit++)
+  {
+    pte_set_fpn(&mm->pgd[pgn + pgit], shm->fpns[pgit]);
+    SETBIT(mm->pgd[pgn + pgit], PAGING_PTE_SHARED_MASK);
+    MEMPHY_ref_frame(caller->mram, shm->fpns[pgit]);
+  }
+  shm->nattch++;
+
+  *addr = start;
+  return shm->size;
+}
+
+/* Segment mapped by a VM_SHARED area, found by its first frame */
+static struct shm_struct *shm_of_vma(struct mm_struct *mm, struct vm_area_struct *vma)
+{
+  int fpn = PAGING_FPN(mm->pgd[PAGING_PGN(vma->vm_start)]);
+  struct shm_struct *shm;
+
+  for (shm = shm_list; shm != NULL; shm = shm->shm_next)
+    if (shm->fpns[0] == fpn)
+      return shm;
+
+  return NULL;
+}
+
+/*
+ * shm_detach - unmap a shared memory area
+ * @mram : MEMRAM device
+ * @mm   : address space holding the area
+ * @vma  : VM_SHARED area, left empty for the caller to remove
+ *
+ * The last detach of a segment frees it with its frames.
+ */
+int shm_detach(struct memphy_struct *mram, struct mm_struct *mm, struct vm_area_struct *vma)
+{
+  struct shm_struct *shm = shm_of_vma(mm, vma);
+  struct shm_struct **pp;
+  int pgn, pgn_end = DIV_ROUND_UP(vma->vm_end, PAGING_PAGESZ);
+
+  for (pgn = PAGING_PGN(vma->vm_start); pgn < pgn_end; pgn++)
+  {
+    if (PAGING_PAGE_PRESENT(mm->pgd[pgn]))
+      MEMPHY_unref_frame(mram, PAGING_FPN(mm->pgd[pgn]));
+    mm->pgd[pgn] = 0;
+  }
+
+  if (shm == NULL)
+    return -1;
+  if (--shm->nattch > 0)
+    return 0;
+
+  for (pgn = 0; pgn < shm->npages; pgn++)
+    MEMPHY_unref_frame(mram, shm->fpns[pgn]);
+  pp = &shm_list;
+  while (*pp != shm)
+    pp = &(*pp)->shm_next;
+  *pp = shm->shm_next;
+  free(shm->fpns);
+  free(shm);
+
+  return 0;
+}
+
+/* A fork copied the mapping of vma, one more to detach */
+int shm_dup(struct mm_struct *mm, struct vm_area_struct *vma)
+{
+  struct shm_struct *shm = shm_of_vma(mm, vma);
+
+  if (shm == NULL)
+    return -1;
+
+  shm->nattch++;
+  return 0;
+}
+
+/* Frames held by the segments still alive */
+int shm_nframes(void)
+{
+  struct shm_struct *shm;
+  int nframes = 0;
+
+  for (shm = shm_list; shm != NULL; shm = shm->shm_next)
+    nframes += shm->npages;
+
+  return nframes;
+}
+
+// #endif
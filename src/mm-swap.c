@@ -0,0 +1,241 @@
+// #ifdef MM_PAGING
+/*
+ * PAGING based Memory Management
+ * Swap device manager mm/mm-swap.c
+ *
+ * Swap slots are spread over every configured MEMSWP device instead of
+ * filling one device after the other. Devices of the highest priority
+ * holding a free slot are used first; among them the one with the most
+ * free slots wins, ties going round-robin, so devices of the same size
+ * are striped page by page. The device id goes to the PTE swap type.
+ *
+ * With a page cluster above one, each mm reserves that many contiguous
+ * slots at once and fills them with its next evictions, and a swap-in
+ * reads the neighbouring virtual pages of the same cluster ahead.
+ *
+ * A page transfer with a MEMSWP device takes swap_io_lat time slots of
+ * device time, charged to the process that waits for it.
+ */
+
+#include "mm.h"
+#include <stdio.h>
+
+#define SWAP_CLUSTER_MAX 64
+
+static int swap_prio[PAGING_MAX_MMSWP];
+static int swap_prio_set = 0; /* some device got a priority from the config */
+static int swap_next = 0; /* round-robin start for ties */
+static int swap_cluster = 1; /* pages per cluster and readahead window */
+
+static int swap_io_lat = 0; /* slots per page transfer, 0 as fast as MEMRAM */
+
+static unsigned long swap_nout[PAGING_MAX_MMSWP];
+static unsigned long swap_nclust[PAGING_MAX_MMSWP];
+
+/*
+ * swap_set_prio - set the priority of a swap device
+ * @swptyp : device id
+ * @prio   : higher is used first, all devices default to 0
+ */
+int swap_set_prio(int swptyp, int prio)
+{
+  if (swptyp < 0 || swptyp >= PAGING_MAX_MMSWP)
+    return -1;
+
+  swap_prio[swptyp] = prio;
+  swap_prio_set = 1;
+  return 0;
+}
+
+/*
+ * swap_set_cluster - set the swap-out cluster and readahead window
+ * @npages : pages, 1 turns both off
+ */
+int swap_set_cluster(int npages)
+{
+  if (npages < 1 || npages > SWAP_CLUSTER_MAX)
+    return -1;
+
+  swap_cluster = npages;
+  return 0;
+}
+
+int swap_get_cluster(void)
+{
+  return swap_cluster;
+}
+
+/*
+ * swap_set_latency - set the device time of a page transfer
+ * @slots : time slots, 0 makes MEMSWP as fast as MEMRAM
+ */
+int swap_set_latency(int slots)
+{
+  if (slots < 0)
+    return -1;
+
+  swap_io_lat = slots;
+  return 0;
+}
+
+/*
+ * swap_io_charge - make a process wait for its page transfers
+ * @caller : process the transfers are done for
+ * @npages : pages transferred
+ */
+void swap_io_charge(struct pcb_t *caller, unsigned long npages)
+{
+  caller->io_slots += npages * swap_io_lat;
+}
+
+int swap_get_latency(void)
+{
+  return swap_io_lat;
+}
+
+static int swap_pick_device(struct memphy_struct *mswp, int nslots)
+{
+  int it, id, best = -1;
+
+  for (it = 0; it < PAGING_MAX_MMSWP; it++)
+  {
+    id = (swap_next + it) % PAGING_MAX_MMSWP;
+    if (mswp[id].free_fp_cnt < nslots)
+      continue;
+
+    if (best < 0 || swap_prio[id] > swap_prio[best] ||
+        (swap_prio[id] == swap_prio[best] &&
+         mswp[id].free_fp_cnt > mswp[best].free_fp_cnt))
+      best = id;
+  }
+
+  if (best >= 0)
+    swap_next = (best + 1) % PAGING_MAX_MMSWP;
+  return best;
+}
+
+/*
+ * swap_get_slot - pick a device and take one of its free slots
+ * @mswp   : array of the swap devices
+ * @swptyp : returned device id
+ * @swpoff : returned slot
+ */
+int swap_get_slot(struct memphy_struct *mswp, int *swptyp, int *swpoff)
+{
+  int best = swap_pick_device(mswp, 1);
+
+  if (best < 0 || MEMPHY_get_freefp(&mswp[best], swpoff) < 0)
+    return -1;
+
+  swap_nout[best]++;
+
+  *swptyp = best;
+  return 0;
+}
+
+/*
+ * swap_get_cluster_slot - take the next slot of the mm's swap cluster,
+ *                         reserving a new cluster when it is used up
+ * @mm     : address space the evicted page belongs to
+ * @mswp   : array of the swap devices
+ * @swptyp : returned device id
+ * @swpoff : returned slot
+ */
+int swap_get_cluster_slot(struct mm_struct *mm, struct memphy_struct *mswp,
+                          int *swptyp, int *swpoff)
+{
+  int best, start;
+
+  if (mm->swp_clleft == 0 && swap_cluster > 1)
+  {
+    best = swap_pick_device(mswp, swap_cluster);
+    if (best >= 0 &&
+        MEMPHY_get_freefp_range(&mswp[best], swap_cluster, &start) == 0)
+    {
+      mm->swp_cltyp = best;
+      mm->swp_clnext = start;
+      mm->swp_clleft = swap_cluster;
+      swap_nclust[best]++;
+    }
+  }
+
+  /* No cluster (off, or no contiguous run left), fall back to any slot */
+  if (mm->swp_clleft == 0)
+    return swap_get_slot(mswp, swptyp, swpoff);
+
+  *swptyp = mm->swp_cltyp;
+  *swpoff = mm->swp_clnext++;
+  mm->swp_clleft--;
+  swap_nout[*swptyp]++;
+  return 0;
+}
+
+/*
+ * swapin_readahead - bring back the swapped neighbours of a faulted page
+ * @caller : caller
+ * @pgn    : page just swapped in
+ *
+ * Only frames already free are used, readahead never evicts. Pages read
+ * ahead carry PAGING_PTE_READAHEAD_MASK until their first access.
+ */
+int swapin_readahead(struct pcb_t *caller, int pgn)
+{
+  struct mm_struct *mm = caller->mm;
+  int start, it, fpn, nread = 0;
+
+  if (swap_cluster <= 1)
+    return 0;
+
+  start = pgn - pgn % swap_cluster;
+  for (it = start; it < start + swap_cluster && it < PAGING_MAX_PGN; it++)
+  {
+    if (it == pgn || !PAGING_PAGE_SWAPPED(mm->pgd[it]))
+      continue;
+
+    if (numa_alloc_frame(caller, &fpn) < 0)
+      break;
+
+    if (swap_in_page(caller, it, fpn) < 0)
+    {
+      MEMPHY_put_freefp(caller->mram, fpn);
+      continue;
+    }
+
+    pte_set_fpn(&mm->pgd[it], fpn);
+    SETBIT(mm->pgd[it], PAGING_PTE_READAHEAD_MASK);
+    MEMPHY_set_owner(caller->mram, fpn, mm, it);
+    caller->mram->frmtbl[fpn].flags &= ~FRAME_REFERENCED;
+    enlist_pgn_node(&mm->fifo_pgn, it);
+    nread++;
+  }
+
+  mm_stat.ra_pages += nread;
+  return nread;
+}
+
+/*
+ * print_swap_stat - usage of each configured swap device
+ * @mswp : array of the PAGING_MAX_MMSWP devices
+ *
+ * Only runs that set device priorities or swap clusters print it.
+ */
+int print_swap_stat(struct memphy_struct *mswp)
+{
+  int id;
+
+  if (!swap_prio_set && swap_cluster <= 1)
+    return 0;
+
+  for (id = 0; id < PAGING_MAX_MMSWP; id++)
+  {
+    if (mswp[id].maxfpn == 0)
+      continue;
+    printf("swap device %d: prio %d, %d/%d slots used, %lu swap outs in %lu clusters\n",
+           id, swap_prio[id], mswp[id].maxfpn - mswp[id].free_fp_cnt,
+           mswp[id].maxfpn, swap_nout[id], swap_nclust[id]);
+  }
+
+  return 0;
+}
+
+// #endif
@@ -0,0 +1,263 @@
+// #ifdef MM_PAGING
+/*
+ * PAGING based Memory Management
+ * Asynchronous swap I/O mm/mm-swapio.c
+ *
+ * Each MEMSWP device gets a submission queue. A page-out copies the victim
+ * to a bounce buffer and submits it, its frame being free for reuse at
+ * once, so the evicting process does not wait for the device. The swapio kernel thread serves every device once per time
+ * slot: the head of a submission queue is written to its slot after the
+ * device latency of swap_set_latency() and its buffer is released on the
+ * spot, nobody waits on it. A read of a slot whose write is still
+ * in flight is served from the buffer. With a full queue, or the engine
+ * off, a page-out is written in the caller as before.
+ */
+
+#include "mm.h"
+#include "libmem.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+struct swapio_req
+{
+  int swpoff;             /* -1 once a later write of the slot replaced it */
+  unsigned long submitted; /* service tick of the submission */
+  BYTE *data;
+};
+
+/* Ring of requests, head being the oldest */
+struct swapio_ring
+{
+  struct swapio_req req[SWAPIO_QDEPTH_MAX];
+  int head;
+  int count;
+};
+
+struct swapio_dev
+{
+  struct swapio_ring sq; /* submitted, the head one in service */
+  int busy;              /* ticks the head request has been served */
+};
+
+static struct swapio_dev swapio_devs[PAGING_MAX_MMSWP];
+static struct memphy_struct *swapio_mswp = NULL;
+static int swapio_depth = 0; /* 0 keeps the engine off */
+static unsigned long swapio_tick = 0;
+
+static struct
+{
+  unsigned long submitted;
+  unsigned long completed;
+  unsigned long cancelled; /* replaced by a later write of their slot */
+  unsigned long sync;      /* written in the caller, the queue full */
+  unsigned long read_hits; /* reads served from a buffer in flight */
+  unsigned long latency;   /* ticks from submission to completion */
+  int peak;                /* deepest submission queue */
+} swapio_stat;
+
+static struct swapio_req *ring_at(struct swapio_ring *ring, int i)
+{
+  return &ring->req[(ring->head + i) % SWAPIO_QDEPTH_MAX];
+}
+
+static void ring_push(struct swapio_ring *ring, struct swapio_req *req)
+{
+  *ring_at(ring, ring->count) = *req;
+  ring->count++;
+}
+
+static void ring_pop(struct swapio_ring *ring, struct swapio_req *req)
+{
+  *req = ring->req[ring->head];
+  ring->head = (ring->head + 1) % SWAPIO_QDEPTH_MAX;
+  ring->count--;
+}
+
+/*
+ * swapio_init - start the engine
+ * @mswp  : array of the swap devices
+ * @depth : submission queue depth of each device, 0 leaves it off
+ */
+int swapio_init(struct memphy_struct *mswp, int depth)
+{
+  if (depth < 0 || depth > SWAPIO_QDEPTH_MAX)
+    return -1;
+
+  swapio_mswp = mswp;
+  swapio_depth = depth;
+  return 0;
+}
+
+/* Drop the writes of a slot still waiting for the device */
+static void swapio_cancel(struct swapio_dev *dev, int swpoff)
+{
+  struct swapio_req *req;
+  int i;
+
+  for (i = 0; i < dev->sq.count; i++)
+  {
+    req = ring_at(&dev->sq, i);
+    if (req->swpoff != swpoff)
+      continue;
+    req->swpoff = -1;
+    free(req->data);
+    req->data = NULL;
+    swapio_stat.cancelled++;
+  }
+}
+
+/*
+ * swapio_write - write a MEMRAM frame to a swap slot
+ * @mram   : source device
+ * @fpn    : source frame
+ * @mswp   : swap device
+ * @swptyp : its id
+ * @swpoff : slot
+ *
+ * Return 1 when the write was queued, 0 when it is done already.
+ */
+int swapio_write(struct memphy_struct *mram, int fpn, struct memphy_struct *mswp,
+                 int swptyp, int swpoff)
+{
+  struct swapio_dev *dev = &swapio_devs[swptyp];
+  struct swapio_req req;
+  int cellidx;
+
+  if (swapio_depth > 0)
+    swapio_cancel(dev, swpoff);
+
+  if (swapio_depth == 0 || dev->sq.count >= swapio_depth)
+  {
+    __swap_cp_page(mram, fpn, mswp, swpoff);
+    if (swapio_depth > 0)
+      swapio_stat.sync++;
+    return 0;
+  }
+
+  req.swpoff = swpoff;
+  req.submitted = swapio_tick;
+  req.data = malloc(PAGING_PAGESZ);
+  for (cellidx = 0; cellidx < PAGING_PAGESZ; cellidx++)
+    MEMPHY_read(mram, fpn * PAGING_PAGESZ + cellidx, &req.data[cellidx]);
+
+  ring_push(&dev->sq, &req);
+  swapio_stat.submitted++;
+  if (dev->sq.count > swapio_stat.peak)
+    swapio_stat.peak = dev->sq.count;
+  return 1;
+}
+
+/*
+ * swapio_read - serve a read of a slot whose write is in flight
+ * @swptyp : swap device
+ * @swpoff : slot
+ * @mram   : destination device
+ * @fpn    : destination frame
+ *
+ * Return 0 when the page came from the queue, -1 when the device holds it.
+ */
+int swapio_read(int swptyp, int swpoff, struct memphy_struct *mram, int fpn)
+{
+  struct swapio_dev *dev = &swapio_devs[swptyp];
+  struct swapio_req *req;
+  int i, cellidx;
+
+  for (i = dev->sq.count - 1; i >= 0; i--)
+  {
+    req = ring_at(&dev->sq, i);
+    if (req->swpoff != swpoff)
+      continue;
+    for (cellidx = 0; cellidx < PAGING_PAGESZ; cellidx++)
+      MEMPHY_write(mram, fpn * PAGING_PAGESZ + cellidx, req->data[cellidx]);
+    swapio_stat.read_hits++;
+    return 0;
+  }
+
+  return -1;
+}
+
+/* Write the head request of a device to its slot */
+static void swapio_complete_head(int id)
+{
+  struct swapio_dev *dev = &swapio_devs[id];
+  struct swapio_req req;
+  int cellidx;
+
+  ring_pop(&dev->sq, &req);
+  dev->busy = 0;
+
+  /* A replaced write has nothing left to do */
+  if (req.swpoff < 0)
+    return;
+
+  for (cellidx = 0; cellidx < PAGING_PAGESZ; cellidx++)
+    MEMPHY_write(swapio_mswp + id, req.swpoff * PAGING_PAGESZ + cellidx,
+                 req.data[cellidx]);
+  free(req.data);
+  swapio_stat.completed++;
+  swapio_stat.latency += swapio_tick - req.submitted;
+}
+
+/*
+ * swapio_service - one time slot of every swap device
+ *
+ * A device writes one page per swap_get_latency() slots, at least one.
+ */
+int swapio_service(void)
+{
+  int id, lat = swap_get_latency();
+  struct swapio_dev *dev;
+
+  if (swapio_depth == 0)
+    return 0;
+
+  pthread_mutex_lock(&mmvm_lock);
+  swapio_tick++;
+  for (id = 0; id < PAGING_MAX_MMSWP; id++)
+  {
+    dev = &swapio_devs[id];
+
+    /* Replaced requests take no device time */
+    while (dev->sq.count > 0 && dev->sq.req[dev->sq.head].swpoff < 0)
+      swapio_complete_head(id);
+    if (dev->sq.count == 0)
+      continue;
+
+    if (++dev->busy >= lat)
+      swapio_complete_head(id);
+  }
+  pthread_mutex_unlock(&mmvm_lock);
+  return 0;
+}
+
+/* Complete every request left, the processes are gone */
+int swapio_drain(void)
+{
+  int id;
+
+  if (swapio_depth == 0)
+    return 0;
+
+  pthread_mutex_lock(&mmvm_lock);
+  for (id = 0; id < PAGING_MAX_MMSWP; id++)
+    while (swapio_devs[id].sq.count > 0)
+      swapio_complete_head(id);
+  pthread_mutex_unlock(&mmvm_lock);
+  return 0;
+}
+
+int print_swapio_stat(void)
+{
+  if (swapio_depth == 0)
+    return 0;
+
+  printf("swap io: %lu writes queued, %lu completed, %lu replaced in queue, %lu written in the caller\n",
+         swapio_stat.submitted, swapio_stat.completed, swapio_stat.cancelled, swapio_stat.sync);
+  printf("swap io: avg completion %.2f slots, peak queue %d/%d, %lu reads served from the queue\n",
+         swapio_stat.completed ? (double)swapio_stat.latency / swapio_stat.completed : 0.0,
+         swapio_stat.peak, swapio_depth, swapio_stat.read_hits);
+  return 0;
+}
+
+// #endif
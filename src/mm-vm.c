@@ -10,37 +10,235 @@
 #include <stdio.h>
 #include <pthread.h>
 
+/*vma_addr_cmp - order of two areas in the address index
+ * Areas never overlap, ties on vm_start only come from empty areas
+ * which are placed before the area starting at the same address.
+ */
+static int vma_addr_cmp(struct vm_area_struct *a, struct vm_area_struct *b)
+{
+  if (a->vm_start != b->vm_start)
+    return (a->vm_start < b->vm_start) ? -1 : 1;
+  if (a->vm_end != b->vm_end)
+    return (a->vm_end < b->vm_end) ? -1 : 1;
+  return 0;
+}
+
+/*vma_search_id - position of vmaid in the ID index
+ *@mm: memory region
+ *@vmaid: ID vm area
+ *
+ * Return the index of the first area whose vm_id is not below vmaid.
+ */
+static int vma_search_id(struct mm_struct *mm, unsigned long vmaid)
+{
+  int lo = 0, hi = mm->map_count;
+
+  while (lo < hi)
+  {
+    int mid = (lo + hi) / 2;
+    if (mm->mmap_by_id[mid]->vm_id < vmaid)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+/*vma_search_addr - number of areas starting below addr
+ *@mm: memory region
+ *@addr: virtual address
+ *
+ */
+static int vma_search_addr(struct mm_struct *mm, unsigned long addr)
+{
+  int lo = 0, hi = mm->map_count;
+
+  while (lo < hi)
+  {
+    int mid = (lo + hi) / 2;
+    if (mm->mmap_by_addr[mid]->vm_start < addr)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
 /*get_vma_by_num - get vm area by numID
  *@mm: memory region
  *@vmaid: ID vm area to alloc memory region
  *
  */
-//TODO: static pthread_mutex_t mem_lock; 
-
 struct vm_area_struct *get_vma_by_num(struct mm_struct *mm, int vmaid)
 {
-  struct vm_area_struct *pvma = mm->mmap;
+  int idx;
+
+  if (mm == NULL || vmaid < 0)
+    return NULL;
+
+  idx = vma_search_id(mm, vmaid);
+  if (idx < mm->map_count && mm->mmap_by_id[idx]->vm_id == vmaid)
+    return mm->mmap_by_id[idx];
+
+  return NULL;
+}
+
+/*find_vma - get the vm area containing a virtual address
+ *@mm: memory region
+ *@addr: virtual address
+ *
+ */
+struct vm_area_struct *find_vma(struct mm_struct *mm, unsigned long addr)
+{
+  struct vm_area_struct *vma;
+  int idx;
 
-  if (mm->mmap == NULL)
+  if (mm == NULL)
     return NULL;
 
-  int vmait = pvma->vm_id;
+  /* The candidate is the last area starting at or below addr */
+  idx = vma_search_addr(mm, addr + 1);
+  if (idx == 0)
+    return NULL;
+
+  vma = mm->mmap_by_addr[idx - 1];
+  return (addr < vma->vm_end) ? vma : NULL;
+}
+
+/*insert_vm_area - attach a new vm area to the memory map
+ *@mm: memory region
+ *@vma: area, its vm_id must be unused and its range must be free
+ *
+ */
+int insert_vm_area(struct mm_struct *mm, struct vm_area_struct *vma)
+{
+  struct vm_area_struct **by_addr, **by_id;
+  int aidx, iidx, cap;
+
+  if (vma->vm_end > PAGING_VMA_LIMIT)
+    return -1;
+
+  iidx = vma_search_id(mm, vma->vm_id);
+  if (iidx < mm->map_count && mm->mmap_by_id[iidx]->vm_id == vma->vm_id)
+    return -1; /* Duplicated vm_id */
+
+  /* Neighbours in address order are the only areas it may overlap */
+  aidx = vma_search_addr(mm, vma->vm_start);
+  while (aidx < mm->map_count && vma_addr_cmp(mm->mmap_by_addr[aidx], vma) < 0)
+    aidx++;
+  if (aidx > 0 && OVERLAP(vma->vm_start, vma->vm_end,
+                          mm->mmap_by_addr[aidx - 1]->vm_start,
+                          mm->mmap_by_addr[aidx - 1]->vm_end))
+    return -1;
+  if (aidx < mm->map_count && OVERLAP(vma->vm_start, vma->vm_end,
+                                      mm->mmap_by_addr[aidx]->vm_start,
+                                      mm->mmap_by_addr[aidx]->vm_end))
+    return -1;
+
+  if (mm->map_count == mm->map_cap)
+  {
+    cap = (mm->map_cap > 0) ? mm->map_cap * 2 : 4;
+    by_addr = realloc(mm->mmap_by_addr, cap * sizeof(struct vm_area_struct *));
+    if (by_addr == NULL)
+      return -1;
+    mm->mmap_by_addr = by_addr;
+    by_id = realloc(mm->mmap_by_id, cap * sizeof(struct vm_area_struct *));
+    if (by_id == NULL)
+      return -1;
+    mm->mmap_by_id = by_id;
+    mm->map_cap = cap;
+  }
+
+  memmove(&mm->mmap_by_addr[aidx + 1], &mm->mmap_by_addr[aidx],
+          (mm->map_count - aidx) * sizeof(struct vm_area_struct *));
+  mm->mmap_by_addr[aidx] = vma;
+  memmove(&mm->mmap_by_id[iidx + 1], &mm->mmap_by_id[iidx],
+          (mm->map_count - iidx) * sizeof(struct vm_area_struct *));
+  mm->mmap_by_id[iidx] = vma;
+  mm->map_count++;
 
-  while (vmait < vmaid)
+  /* Keep the traversal list in the same address order */
+  if (aidx == 0)
+  {
+    vma->vm_next = mm->mmap;
+    mm->mmap = vma;
+  }
+  else
   {
-    if (pvma == NULL)
-      return NULL;
+    vma->vm_next = mm->mmap_by_addr[aidx - 1]->vm_next;
+    mm->mmap_by_addr[aidx - 1]->vm_next = vma;
+  }
+  vma->vm_mm = mm;
+
+  return 0;
+}
+
+/*remove_vm_area - detach an area from the memory map
+ *@mm: memory region
+ *@vma: area of mm, freed by the caller
+ *
+ */
+int remove_vm_area(struct mm_struct *mm, struct vm_area_struct *vma)
+{
+  struct vm_area_struct **pp;
+  int aidx, iidx;
+
+  aidx = vma_search_addr(mm, vma->vm_start);
+  while (aidx < mm->map_count && mm->mmap_by_addr[aidx] != vma)
+    aidx++;
+  iidx = vma_search_id(mm, vma->vm_id);
+  if (aidx == mm->map_count || iidx == mm->map_count || mm->mmap_by_id[iidx] != vma)
+    return -1;
+
+  memmove(&mm->mmap_by_addr[aidx], &mm->mmap_by_addr[aidx + 1],
+          (mm->map_count - aidx - 1) * sizeof(struct vm_area_struct *));
+  memmove(&mm->mmap_by_id[iidx], &mm->mmap_by_id[iidx + 1],
+          (mm->map_count - iidx - 1) * sizeof(struct vm_area_struct *));
+  mm->map_count--;
+
+  for (pp = &mm->mmap; *pp != NULL; pp = &(*pp)->vm_next)
+    if (*pp == vma)
+    {
+      *pp = vma->vm_next;
+      break;
+    }
+
+  return 0;
+}
 
-    pvma = pvma->vm_next;
-    vmait = pvma->vm_id;
+/*get_unmapped_area - find a free range for a new area
+ *@mm: memory region
+ *@len: page aligned length
+ *
+ * Search from the top of the address space down, so mappings stay away
+ * from the heap growing up from address 0. Return the start or -1.
+ */
+long get_unmapped_area(struct mm_struct *mm, unsigned long len)
+{
+  unsigned long end = PAGING_VMA_LIMIT;
+  unsigned long lo;
+  int idx;
+
+  for (idx = mm->map_count - 1; idx >= -1; idx--)
+  {
+    lo = (idx >= 0) ? mm->mmap_by_addr[idx]->vm_end : 0;
+    if (end >= lo + len)
+      return end - len;
+    if (idx >= 0)
+      end = mm->mmap_by_addr[idx]->vm_start;
   }
 
-  return pvma;
+  return -1;
 }
 
 int __mm_swap_page(struct pcb_t *caller, int vicfpn , int swpfpn)
 {
-    __swap_cp_page(caller->mram, vicfpn, caller->active_mswp, swpfpn);
+    /* Queued behind the device, or written now and waited for */
+    if (swapio_write(caller->mram, vicfpn, caller->active_mswp,
+                     caller->active_mswp_id, swpfpn) == 0)
+        swap_io_charge(caller, 1);
     return 0;
 }
 
@@ -55,20 +253,17 @@ int __mm_swap_page(struct pcb_t *caller, int vicfpn , int swpfpn)
 struct vm_rg_struct *get_vm_area_node_at_brk(struct pcb_t *caller, int vmaid, int size, int alignedsz)
 {
   struct vm_rg_struct * newrg;
-  /* TODO retrive current vma to obtain newrg, current comment out due to compiler redundant warning*/
-  //TODO: 11/04/2025
-  struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);  
+  struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
+
+  if (cur_vma == NULL)
+    return NULL;
 
   newrg = malloc(sizeof(struct vm_rg_struct));
-  
-  //TODO: 11/04/2025
-  newrg->rg_start = cur_vma->sbrk; 
-  newrg->rg_end = newrg->rg_start + size;
 
-  /* TODO: update the newrg boundary
-  // newrg->rg_start = ...
-  // newrg->rg_end = ...
-  */
+  /* The new node spans the aligned growth right above the break */
+  newrg->rg_start = cur_vma->sbrk;
+  newrg->rg_end = newrg->rg_start + alignedsz;
+  newrg->rg_next = NULL;
 
   return newrg;
 }
@@ -79,24 +274,29 @@ struct vm_rg_struct *get_vm_area_node_at_brk(struct pcb_t *caller, int vmaid, in
  *@vmastart: vma end
  *@vmaend: vma end
  *
+ * Check [vmastart, vmaend) against every other area in O(log n): areas
+ * are disjoint and sorted, so among those starting below vmaend the last
+ * one also ends last and is the only one that needs to be compared.
  */
 int validate_overlap_vm_area(struct pcb_t *caller, int vmaid, int vmastart, int vmaend)
 {
-  //TODO: 11/04/2025
-  struct vm_area_struct *vma = caller->mm->mmap;
+  struct mm_struct *mm = caller->mm;
+  struct vm_area_struct *vma;
+  int idx;
 
-  /* TODO validate the planned memory area is not overlapped */
-  while (!vma)
+  if (vmastart < 0 || vmaend < vmastart || vmaend > PAGING_VMA_LIMIT)
+    return -1;
+
+  idx = vma_search_addr(mm, vmaend);
+  while (idx > 0)
   {
-    if((vma->vm_id != vmaid) && (vma->vm_start != vma->vm_end))
-    {
-      if((int)((vmaend - 1 - vma->vm_start) * (vma->vm_end - 1 - vmastart))>=0)
-      return -1;
-      if((int)((vmastart - vma->vm_start) * (vma->vm_end - vmaend)) >= 0)
-      return -1;
-    }
-    vma = vma->vm_next;
+    vma = mm->mmap_by_addr[--idx];
+    if (vma->vm_id == vmaid)
+      continue;
+
+    return OVERLAP(vmastart, vmaend, vma->vm_start, vma->vm_end) ? -1 : 0;
   }
+
   return 0;
 }
 
@@ -108,29 +308,42 @@ int validate_overlap_vm_area(struct pcb_t *caller, int vmaid, int vmastart, int
  */
 int inc_vma_limit(struct pcb_t *caller, int vmaid, int inc_sz)
 {
-  struct vm_rg_struct * newrg = malloc(sizeof(struct vm_rg_struct));
+  struct vm_rg_struct newrg;
   int inc_amt = PAGING_PAGE_ALIGNSZ(inc_sz);
   int incnumpage =  inc_amt / PAGING_PAGESZ;
   struct vm_rg_struct *area = get_vm_area_node_at_brk(caller, vmaid, inc_sz, inc_amt);
   struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
+  int old_end;
 
-  int old_end = cur_vma->vm_end;
+  if (area == NULL || cur_vma == NULL)
+  {
+    free(area);
+    return -1;
+  }
 
   /*Validate overlap of obtained region */
   if (validate_overlap_vm_area(caller, vmaid, area->rg_start, area->rg_end) < 0)
+  {
+    free(area);
     return -1; /*Overlap and failed allocation */
+  }
 
-  /* TODO: Obtain the new vm area based on vmaid */
-  //TODO: 11/4/2025
-  //cur_vma->vm_end... 
-  // inc_limit_ret...
-  cur_vma->vm_end += inc_sz;
-  cur_vma->sbrk += inc_sz;
-
-  if (vm_map_ram(caller, area->rg_start, area->rg_end, 
-                    old_end, incnumpage , newrg) < 0)
+  old_end = cur_vma->vm_end;
+  /* Demand paging only reserves the virtual space, frames come at first
+   * touch */
+  if (!paging_get_demand() &&
+      vm_map_ram(caller, area->rg_start, area->rg_end,
+                    old_end, incnumpage , &newrg) < 0)
+  {
+    free(area);
     return -1; /* Map the memory to MEMRAM */
+  }
+
+  /* Commit the new limit once the pages are mapped */
+  cur_vma->vm_end += inc_amt;
+  cur_vma->sbrk += inc_amt;
 
+  free(area);
   return 0;
 }
 
@@ -0,0 +1,163 @@
+// #ifdef MM_PAGING
+/*
+ * PAGING based Memory Management
+ * Page reclaim mm/mm-vmscan.c
+ */
+
+#include "mm.h"
+#include "libmem.h"
+#include <stdio.h>
+
+/* Victims are chosen among the frames of every process (global) or,
+ * per mm, by its own FIFO replacement list (local) */
+static int vmscan_global = 1;
+
+/* Clock hand over the MEMRAM frames */
+static int clock_hand = 0;
+
+/* Next address space to take a victim from, local mode */
+static struct mm_struct *kswapd_mm = NULL;
+
+/*
+ * vmscan_set_global - select the replacement scope
+ * @global : 1 for global replacement, 0 for per process
+ */
+int vmscan_set_global(int global)
+{
+  vmscan_global = global;
+  return 0;
+}
+
+/*
+ * clock_victim - second chance clock over the MEMRAM frame table
+ * @mram   : MEMRAM device
+ * @retfpn : returned frame, mapped once by a page that may be evicted
+ *
+ * Frames with several mappings (copy-on-write, merged or shared memory)
+ * are skipped, as is any frame whose recorded owner PTE no longer maps
+ * it. A referenced frame loses its bit and is passed over once.
+ */
+static int clock_victim(struct memphy_struct *mram, int *retfpn)
+{
+  struct framedesc_struct *fd;
+  uint32_t pte;
+  int it;
+
+  for (it = 0; it < 2 * mram->maxfpn; it++)
+  {
+    fd = &mram->frmtbl[clock_hand];
+    *retfpn = clock_hand;
+    clock_hand = (clock_hand + 1) % mram->maxfpn;
+
+    if (fd->refcnt != 1 || fd->owner == NULL)
+      continue;
+
+    pte = fd->owner->pgd[fd->pgn];
+    if (!PAGING_PAGE_PRESENT(pte) || PAGING_FPN(pte) != *retfpn ||
+        (pte & PAGING_PTE_SHARED_MASK))
+      continue;
+
+    if (fd->flags & FRAME_REFERENCED)
+    {
+      fd->flags &= ~FRAME_REFERENCED;
+      continue;
+    }
+
+    return 0;
+  }
+
+  return -1;
+}
+
+/*
+ * reclaim_global - evict the coldest page of any process
+ * @mram   : MEMRAM device
+ * @mswp   : array of the swap devices
+ * @retmm  : returned address space the page belonged to
+ * @retfpn : returned frame, now unused by any page
+ */
+int reclaim_global(struct memphy_struct *mram, struct memphy_struct *mswp,
+                   struct mm_struct **retmm, int *retfpn)
+{
+  struct mm_struct *mm;
+  int fpn, pgn;
+
+  if (!vmscan_global || clock_victim(mram, &fpn) < 0)
+    return -1;
+
+  mm = mram->frmtbl[fpn].owner;
+  pgn = mram->frmtbl[fpn].pgn;
+  if (swap_out_pgn(mm, pgn, mram, mswp, retfpn) < 0)
+    return -1;
+
+  delist_pgn_node(&mm->fifo_pgn, pgn);
+  *retmm = mm;
+  return 0;
+}
+
+/*
+ * kswapd_balance - refill the MEMRAM free list ahead of the faults
+ * @mram       : MEMRAM device
+ * @mswp       : array of the swap devices
+ * @wmark_low  : reclaim starts when fewer frames than this are free
+ * @wmark_high : ... and stops once this many are free
+ *
+ * With global replacement victims come from the clock over all frames,
+ * otherwise one page at a time from each live mm in turn, each by its
+ * own replacement list. Return the number of frames freed.
+ */
+int kswapd_balance(struct memphy_struct *mram, struct memphy_struct *mswp,
+                   int wmark_low, int wmark_high)
+{
+  struct mm_struct *start, *vicmm;
+  int fpn, nfreed = 0, progress = 0;
+
+  pthread_mutex_lock(&mmvm_lock);
+  pthread_mutex_lock(&mm_list_lock);
+
+  if (vmscan_global && mram->free_fp_cnt < wmark_low)
+  {
+    while (mram->free_fp_cnt < wmark_high &&
+           reclaim_global(mram, mswp, &vicmm, &fpn) == 0)
+    {
+      MEMPHY_put_freefp(mram, fpn);
+      nfreed++;
+    }
+    mm_stat.pgsteal_kswapd += nfreed;
+  }
+  else if (mram->free_fp_cnt < wmark_low && mm_list != NULL)
+  {
+    if (kswapd_mm == NULL || !mm_is_registered(kswapd_mm))
+      kswapd_mm = mm_list;
+    start = kswapd_mm;
+
+    while (mram->free_fp_cnt < wmark_high)
+    {
+      if (swap_out_page(kswapd_mm, mram, mswp, &fpn) >= 0)
+      {
+        MEMPHY_put_freefp(mram, fpn);
+        nfreed++;
+        progress = 1;
+      }
+
+      kswapd_mm = (kswapd_mm->mm_next != NULL) ? kswapd_mm->mm_next : mm_list;
+
+      /* A round over every mm without a single eviction, give up */
+      if (kswapd_mm == start)
+      {
+        if (!progress)
+          break;
+        progress = 0;
+      }
+    }
+
+    mm_stat.pgsteal_kswapd += nfreed;
+  }
+
+  pthread_mutex_unlock(&mm_list_lock);
+  pthread_mutex_unlock(&mmvm_lock);
+
+  return nfreed;
+}
+
+// #endif
@@ -0,0 +1,305 @@
+// #ifdef MM_PAGING
+/*
+ * PAGING based Memory Management
+ * Compressed swap pool mm/mm-zswap.c
+ *
+ * Evicted pages are first offered to an in-memory pool holding them
+ * run-length compressed; all-zero pages take no pool space at all. Pages
+ * that do not shrink enough, or do not fit in the pool, fall through to
+ * the MEMSWP devices. A pooled page is named in its PTE by the swap type
+ * PAGING_SWPTYP_ZSWAP and its entry handle as the swap offset.
+ */
+
+#include "mm.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Largest handle the PTE swap offset field can hold */
+#define ZSWAP_MAX_ENTRY BIT(PAGING_PTE_SWPOFF_HIBIT - PAGING_PTE_SWPOFF_LOBIT + 1)
+
+/* Worst case of the encoding: one control byte per 128 literals */
+#define ZSWAP_PAGESZ_MAX BIT(PAGING_PGSHIFT_MAX)
+#define ZSWAP_BUFSZ (ZSWAP_PAGESZ_MAX + ZSWAP_PAGESZ_MAX / 128 + 1)
+
+struct zswap_entry
+{
+  int refcnt;          /* 0 when the handle is free */
+  int len;             /* compressed length, 0 for a zero page */
+  unsigned char *data;
+};
+
+static struct zswap_entry *zswap_tbl = NULL;
+static int zswap_tbl_sz = 0;
+static int *zswap_freeh = NULL; /* stack of released handles */
+static int zswap_nfreeh = 0;
+
+static unsigned long zswap_pool_sz = 0; /* 0 keeps the pool disabled */
+static unsigned long zswap_pool_used = 0;
+
+static unsigned char zswap_page[ZSWAP_PAGESZ_MAX];
+static unsigned char zswap_buf[ZSWAP_BUFSZ];
+
+static struct
+{
+  unsigned long stored;     /* pages accepted by the pool */
+  unsigned long zero;       /* ... of which all-zero */
+  unsigned long rejected;   /* incompressible or pool full */
+  unsigned long loaded;     /* pages decompressed back to MEMRAM */
+  unsigned long bytes_in;   /* page bytes handed to the pool */
+  unsigned long bytes_out;  /* compressed bytes kept for them */
+  unsigned long pool_peak;
+  unsigned long store_moved; /* bytes read and written by stores */
+  unsigned long load_moved;  /* ... and by loads */
+} zswap_stat;
+
+/*
+ * zswap_compress - PackBits style run-length encoding
+ * A control byte c < 128 is followed by c + 1 literal bytes, c >= 128
+ * by one byte repeated 257 - c times (2 to 129).
+ */
+static int zswap_compress(const unsigned char *src, int len, unsigned char *dst)
+{
+  int i = 0, out = 0, run, lit;
+
+  while (i < len)
+  {
+    for (run = 1; i + run < len && run < 129 && src[i + run] == src[i]; run++)
+      ;
+
+    if (run >= 2)
+    {
+      dst[out++] = (unsigned char)(257 - run);
+      dst[out++] = src[i];
+      i += run;
+      continue;
+    }
+
+    /* Gather literals up to the next run of three, shorter runs cost
+     * no less as literals than as a run of their own */
+    for (lit = 1; i + lit < len && lit < 128; lit++)
+      if (i + lit + 2 < len && src[i + lit] == src[i + lit + 1] &&
+          src[i + lit] == src[i + lit + 2])
+        break;
+
+    dst[out++] = (unsigned char)(lit - 1);
+    memcpy(dst + out, src + i, lit);
+    out += lit;
+    i += lit;
+  }
+
+  return out;
+}
+
+static void zswap_decompress(const unsigned char *src, int len, unsigned char *dst)
+{
+  int i = 0, out = 0, n;
+
+  while (i < len)
+  {
+    if (src[i] < 128)
+    {
+      n = src[i] + 1;
+      memcpy(dst + out, src + i + 1, n);
+      i += n + 1;
+    }
+    else
+    {
+      n = 257 - src[i];
+      memset(dst + out, src[i + 1], n);
+      i += 2;
+    }
+    out += n;
+  }
+}
+
+static int zswap_alloc_handle(void)
+{
+  int oldsz, newsz, h;
+
+  if (zswap_nfreeh > 0)
+    return zswap_freeh[--zswap_nfreeh];
+
+  if (zswap_tbl_sz >= ZSWAP_MAX_ENTRY)
+    return -1;
+
+  oldsz = zswap_tbl_sz;
+  newsz = oldsz ? oldsz * 2 : 64;
+  if (newsz > ZSWAP_MAX_ENTRY)
+    newsz = ZSWAP_MAX_ENTRY;
+
+  zswap_tbl = realloc(zswap_tbl, newsz * sizeof(struct zswap_entry));
+  zswap_freeh = realloc(zswap_freeh, newsz * sizeof(int));
+  memset(zswap_tbl + oldsz, 0, (newsz - oldsz) * sizeof(struct zswap_entry));
+  zswap_tbl_sz = newsz;
+
+  /* Hand out the first new handle, keep the rest for later */
+  for (h = newsz - 1; h > oldsz; h--)
+    zswap_freeh[zswap_nfreeh++] = h;
+  return oldsz;
+}
+
+/*
+ * zswap_init - enable the compressed pool
+ * @poolsz : pool capacity in bytes of compressed data
+ */
+int zswap_init(unsigned long poolsz)
+{
+  zswap_pool_sz = poolsz;
+  return 0;
+}
+
+/*
+ * zswap_store - try to keep a MEMRAM frame in the pool
+ * @mram   : source device
+ * @fpn    : source frame
+ * @handle : returned entry handle, to be used as swap offset
+ */
+int zswap_store(struct memphy_struct *mram, int fpn, int *handle)
+{
+  int cellidx, len, h;
+  BYTE data;
+
+  if (zswap_pool_sz == 0)
+    return -1;
+
+  len = 0;
+  for (cellidx = 0; cellidx < PAGING_PAGESZ; cellidx++)
+  {
+    MEMPHY_read(mram, fpn * PAGING_PAGESZ + cellidx, &data);
+    zswap_page[cellidx] = data;
+    len |= data;
+  }
+
+  /* Zero page shortcut, otherwise keep it only if it saves a quarter */
+  if (len != 0)
+  {
+    len = zswap_compress(zswap_page, PAGING_PAGESZ, zswap_buf);
+    if (len > PAGING_PAGESZ - PAGING_PAGESZ / 4 ||
+        zswap_pool_used + len > zswap_pool_sz)
+    {
+      zswap_stat.rejected++;
+      return -1;
+    }
+  }
+
+  h = zswap_alloc_handle();
+  if (h < 0)
+  {
+    zswap_stat.rejected++;
+    return -1;
+  }
+
+  zswap_tbl[h].refcnt = 1;
+  zswap_tbl[h].len = len;
+  zswap_tbl[h].data = NULL;
+  if (len > 0)
+  {
+    zswap_tbl[h].data = malloc(len);
+    memcpy(zswap_tbl[h].data, zswap_buf, len);
+  }
+  else
+    zswap_stat.zero++;
+
+  zswap_pool_used += len;
+  if (zswap_pool_used > zswap_stat.pool_peak)
+    zswap_stat.pool_peak = zswap_pool_used;
+
+  zswap_stat.stored++;
+  zswap_stat.bytes_in += PAGING_PAGESZ;
+  zswap_stat.bytes_out += len;
+  zswap_stat.store_moved += PAGING_PAGESZ + len;
+
+  *handle = h;
+  return 0;
+}
+
+/*
+ * zswap_load - decompress a pooled page into a MEMRAM frame and drop the
+ *              reference the faulting PTE held on it
+ * @handle : entry handle
+ * @mram   : destination device
+ * @fpn    : destination frame
+ */
+int zswap_load(int handle, struct memphy_struct *mram, int fpn)
+{
+  int cellidx;
+
+  if (handle < 0 || handle >= zswap_tbl_sz || zswap_tbl[handle].refcnt == 0)
+    return -1;
+
+  zswap_stat.load_moved += zswap_tbl[handle].len + PAGING_PAGESZ;
+
+  if (zswap_tbl[handle].len == 0)
+    memset(zswap_page, 0, PAGING_PAGESZ);
+  else
+    zswap_decompress(zswap_tbl[handle].data, zswap_tbl[handle].len, zswap_page);
+
+  for (cellidx = 0; cellidx < PAGING_PAGESZ; cellidx++)
+    MEMPHY_write(mram, fpn * PAGING_PAGESZ + cellidx, zswap_page[cellidx]);
+
+  zswap_put(handle);
+
+  zswap_stat.loaded++;
+  return 0;
+}
+
+/*
+ * zswap_ref - one more PTE names the entry (fork)
+ * @handle : entry handle
+ */
+int zswap_ref(int handle)
+{
+  if (handle < 0 || handle >= zswap_tbl_sz || zswap_tbl[handle].refcnt == 0)
+    return -1;
+
+  zswap_tbl[handle].refcnt++;
+  return 0;
+}
+
+/*
+ * zswap_put - drop a reference, releasing the entry with the last one
+ * @handle : entry handle
+ */
+int zswap_put(int handle)
+{
+  struct zswap_entry *ent;
+
+  if (handle < 0 || handle >= zswap_tbl_sz || zswap_tbl[handle].refcnt == 0)
+    return -1;
+
+  ent = &zswap_tbl[handle];
+  if (--ent->refcnt > 0)
+    return 0;
+
+  zswap_pool_used -= ent->len;
+  free(ent->data);
+  ent->data = NULL;
+  ent->len = 0;
+  zswap_freeh[zswap_nfreeh++] = handle;
+  return 0;
+}
+
+/* Live entries, every handle not on the free stack */
+int zswap_nentries(void)
+{
+  return zswap_tbl_sz - zswap_nfreeh;
+}
+
+int print_zswap_stat(void)
+{
+  if (zswap_pool_sz == 0)
+    return 0;
+
+  printf("zswap: stored %lu (zero %lu), rejected %lu, loaded %lu\n",
+         zswap_stat.stored, zswap_stat.zero, zswap_stat.rejected, zswap_stat.loaded);
+  printf("zswap: compression ratio %.2f (%lu -> %lu bytes), pool peak %lu/%lu bytes\n",
+         (double)zswap_stat.bytes_in / (zswap_stat.bytes_out ? zswap_stat.bytes_out : 1),
+         zswap_stat.bytes_in, zswap_stat.bytes_out, zswap_stat.pool_peak, zswap_pool_sz);
+  printf("zswap: avg store %lu bytes moved/page, avg load %lu bytes moved/page\n",
+         zswap_stat.stored ? zswap_stat.store_moved / zswap_stat.stored : 0,
+         zswap_stat.loaded ? zswap_stat.load_moved / zswap_stat.loaded : 0);
+  return 0;
+}
+
+// #endif
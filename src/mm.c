@@ -7,9 +7,74 @@
 #include "mm.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <pthread.h>
 
 // TODO: struct pgn_t* global_fifo = NULL;
 
+/* Live address spaces, walked by the page scanners */
+struct mm_struct *mm_list = NULL;
+pthread_mutex_t mm_list_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Paging activity counters, reported at shutdown */
+struct mm_stat_struct mm_stat;
+
+/* Page-outs written to MEMSWP in the evicting context, not queued */
+static unsigned long swap_sync_writes = 0;
+
+#ifndef PAGING_FIXED_PGSHIFT
+/* log2 of the page size, 256B unless the config overrides it */
+unsigned int paging_pgshift = PAGING_PGSHIFT_MIN;
+#endif
+
+/*
+ * paging_set_pagesz - select the page size for this run
+ * @pgsz: page size in bytes, a power of two in [256B, 64KB]
+ * Must be called before any memphy or mm is initialized.
+ */
+int paging_set_pagesz(unsigned int pgsz)
+{
+  unsigned int shift;
+
+  if (pgsz == 0 || (pgsz & (pgsz - 1)) != 0)
+    return -1;
+
+  shift = __builtin_ctz(pgsz);
+  if (shift < PAGING_PGSHIFT_MIN || shift > PAGING_PGSHIFT_MAX)
+    return -1;
+
+#ifdef PAGING_FIXED_PGSHIFT
+  return (shift == PAGING_FIXED_PGSHIFT) ? 0 : -1;
+#else
+  paging_pgshift = shift;
+  return 0;
+#endif
+}
+
+/* Frames are mapped at first touch rather than by alloc, the DEMAND
+ * config key overrides the build default */
+#ifdef MM_DEMAND_PAGING
+static int paging_demand = 1;
+#else
+static int paging_demand = 0;
+#endif
+
+/*
+ * paging_set_demand - select demand paging for this run
+ * @on: nonzero to only reserve the pages of an alloc
+ * Must be called before any process is loaded.
+ */
+int paging_set_demand(int on)
+{
+  paging_demand = (on != 0);
+  return 0;
+}
+
+int paging_get_demand(void)
+{
+  return paging_demand;
+}
+
 /*
  * init_pte - Initialize PTE entry
  */
@@ -57,7 +122,10 @@ int init_pte(uint32_t *pte,
  */
 int pte_set_swap(uint32_t *pte, int swptyp, int swpoff)
 {
-  SETBIT(*pte, PAGING_PTE_PRESENT_MASK);
+  /* A swapped page is no longer present in MEMRAM, and its swap copy is
+   * up to date */
+  CLRBIT(*pte, PAGING_PTE_PRESENT_MASK);
+  CLRBIT(*pte, PAGING_PTE_DIRTY_MASK);
   SETBIT(*pte, PAGING_PTE_SWAPPED_MASK);
 
   SETVAL(*pte, swptyp, PAGING_PTE_SWPTYP_MASK, PAGING_PTE_SWPTYP_LOBIT);
@@ -73,6 +141,13 @@ int pte_set_swap(uint32_t *pte, int swptyp, int swpoff)
  */
 int pte_set_fpn(uint32_t *pte, int fpn)
 {
+  if (*pte & PAGING_PTE_SWAPPED_MASK)
+  {
+    /* Drop the swap entry, its fields overlap the FPN */
+    CLRBIT(*pte, PAGING_PTE_SWPTYP_MASK);
+    CLRBIT(*pte, PAGING_PTE_SWPOFF_MASK);
+  }
+
   SETBIT(*pte, PAGING_PTE_PRESENT_MASK);
   CLRBIT(*pte, PAGING_PTE_SWAPPED_MASK);
 
@@ -117,6 +192,8 @@ int vmap_page_range(struct pcb_t *caller,           // process call
     int cur_pgn = pgn + pgit;
     uint32_t *pte = &caller->mm->pgd[cur_pgn];
     pte_set_fpn(pte, fpit->fpn);
+    MEMPHY_set_owner(caller->mram, fpit->fpn, caller->mm, cur_pgn);
+    caller->mm->nr_pages++;
 
     /* Tracking for later page replacement activities (if needed)
      * Enqueue new usage page */
@@ -126,6 +203,177 @@ int vmap_page_range(struct pcb_t *caller,           // process call
   return 0;
 }
 
+/*
+ * swap_out_pgn - evict a present page to swap
+ * @mm     : address space of the page
+ * @vicpgn : page, neither shared nor copy-on-write
+ * @mram   : MEMRAM device
+ * @mswp   : array of the swap devices
+ * @retfpn : returned MEMRAM frame, now unused by any page
+ * The replacement list of mm is left to the caller. Return the swap type
+ * the page went to.
+ */
+int swap_out_pgn(struct mm_struct *mm, int vicpgn, struct memphy_struct *mram,
+                 struct memphy_struct *mswp, int *retfpn)
+{
+  int vicfpn, swpfpn, swptyp;
+
+  vicfpn = PAGING_FPN(mm->pgd[vicpgn]);
+
+  /* A clean page goes back to the slot it still equals, unwritten */
+  if (!(mm->pgd[vicpgn] & PAGING_PTE_DIRTY_MASK) &&
+      MEMPHY_take_swpcache(mram, vicfpn, &swptyp, &swpfpn) == 0)
+  {
+    mm_stat.pgswapout_clean++;
+  }
+  else
+  {
+    /* A page the compressed pool accepts never reaches MEMSWP */
+    if (zswap_store(mram, vicfpn, &swpfpn) == 0)
+      swptyp = PAGING_SWPTYP_ZSWAP;
+    else if (swap_get_cluster_slot(mm, mswp, &swptyp, &swpfpn) == 0)
+    {
+      if (swapio_write(mram, vicfpn, mswp + swptyp, swptyp, swpfpn) == 0)
+        swap_sync_writes++;
+    }
+    else
+      return -3000; /* swap is full, the victim stays online */
+
+    MEMPHY_drop_swpcache(mram, vicfpn);
+    mm_stat.pgswapout++;
+  }
+
+  /* Read ahead but never used */
+  CLRBIT(mm->pgd[vicpgn], PAGING_PTE_READAHEAD_MASK);
+  pte_set_swap(&mm->pgd[vicpgn], swptyp, swpfpn);
+  MEMPHY_clear_owner(mram, vicfpn);
+
+  *retfpn = vicfpn;
+  return swptyp;
+}
+
+/*
+ * swap_out_page - evict the next victim page of an mm to swap
+ * @mm     : address space to take the victim from
+ * @mram   : MEMRAM device
+ * @mswp   : array of the swap devices
+ * @retfpn : returned MEMRAM frame, now unused by any page
+ * Return the swap type the page went to.
+ */
+int swap_out_page(struct mm_struct *mm, struct memphy_struct *mram,
+                  struct memphy_struct *mswp, int *retfpn)
+{
+  int vicpgn, swptyp;
+
+  if (find_victim_page(mm, mram, &vicpgn) < 0)
+    return -1;
+
+  swptyp = swap_out_pgn(mm, vicpgn, mram, mswp, retfpn);
+  if (swptyp < 0)
+    enlist_pgn_node(&mm->fifo_pgn, vicpgn);
+
+  return swptyp;
+}
+
+/*
+ * swap_out_victim - evict a page of the caller to swap and take its frame
+ * @caller : caller
+ * @retfpn : returned MEMRAM frame, now unused by any page
+ */
+int swap_out_victim(struct pcb_t *caller, int *retfpn)
+{
+  struct memphy_struct *mswp = (struct memphy_struct *)caller->mswp;
+  int swptyp;
+
+  swptyp = swap_out_page(caller->mm, caller->mram, mswp, retfpn);
+  if (swptyp < 0)
+    return swptyp;
+
+  /* The active swap device follows the last one used */
+  if (swptyp < PAGING_MAX_MMSWP)
+  {
+    caller->active_mswp = mswp + swptyp;
+    caller->active_mswp_id = swptyp;
+  }
+
+  return 0;
+}
+
+/*
+ * get_free_frame - obtain a MEMRAM frame, swapping a victim out if needed
+ * @caller : caller
+ * @retfpn : returned frame
+ */
+int get_free_frame(struct pcb_t *caller, int *retfpn)
+{
+  struct mm_struct *vicmm;
+  unsigned long nwrites;
+  int ret;
+
+  if (numa_alloc_frame(caller, retfpn) == 0)
+    return 0;
+
+  /* Direct reclaim, the background one did not keep up. The coldest page
+   * of any process goes first, the caller's own pages otherwise. */
+  mm_stat.pgsteal_direct++;
+  nwrites = swap_sync_writes;
+  if (reclaim_global(caller->mram, (struct memphy_struct *)caller->mswp,
+                     &vicmm, retfpn) == 0)
+  {
+    if (vicmm != caller->mm)
+      mm_stat.pgsteal_foreign++;
+    ret = 0;
+  }
+  else
+    ret = swap_out_victim(caller, retfpn);
+
+  /* The caller waits for its victim to reach the device, unless the
+   * write went to the I/O queue */
+  swap_io_charge(caller, swap_sync_writes - nwrites);
+  return ret;
+}
+
+/*
+ * swap_in_page - bring a swapped page back to a MEMRAM frame
+ * @caller : caller
+ * @pgn    : swapped page number
+ * @fpn    : destination frame
+ */
+int swap_in_page(struct pcb_t *caller, int pgn, int fpn)
+{
+  struct memphy_struct *mswp = (struct memphy_struct *)caller->mswp;
+  uint32_t pte = caller->mm->pgd[pgn];
+  int swptyp = PAGING_SWPTYP(pte);
+
+  if (swptyp == PAGING_SWPTYP_ZSWAP)
+  {
+    if (zswap_load(PAGING_SWPFPN(pte), caller->mram, fpn) < 0)
+      return -1;
+    mm_stat.pgswapin++;
+    return 0;
+  }
+
+  if (swptyp >= PAGING_MAX_MMSWP)
+    return -1;
+
+  /* A page still on its way to the device needs no read */
+  if (swapio_read(swptyp, PAGING_SWPFPN(pte), caller->mram, fpn) < 0)
+  {
+    __swap_cp_page(mswp + swptyp, PAGING_SWPFPN(pte), caller->mram, fpn);
+    swap_io_charge(caller, 1);
+  }
+  mm_stat.pgswapin++;
+
+  /* Keep the slot while the device has room, a clean eviction then needs
+   * no write; otherwise give the slot of this mapping back */
+  if (2 * mswp[swptyp].free_fp_cnt >= mswp[swptyp].maxfpn)
+    MEMPHY_set_swpcache(caller->mram, fpn, mswp + swptyp, swptyp, PAGING_SWPFPN(pte));
+  else if (MEMPHY_unref_frame(mswp + swptyp, PAGING_SWPFPN(pte)) == 0)
+    mm_stat.swpslot_freed++;
+
+  return 0;
+}
+
 /*
  * alloc_pages_range - allocate req_pgnum of frame in ram
  * @caller    : caller
@@ -134,82 +382,33 @@ int vmap_page_range(struct pcb_t *caller,           // process call
  */
 int alloc_pages_range(struct pcb_t *caller, int req_pgnum, struct framephy_struct **frm_lst)
 {
-  int pgit, fpn;
+  int pgit, fpn, ret;
   struct framephy_struct *newfp_str = NULL;
 
-  /* TODO: allocate the page
-  //caller-> ...
-  //frm_lst-> ...
-  */
-
   for (pgit = 0; pgit < req_pgnum; pgit++)
   {
-    /* TODO: allocate the page
-     */
-    // TODO: 11/04/2025
-    if (MEMPHY_get_freefp(caller->mram, &fpn) == 0)
+    ret = get_free_frame(caller, &fpn);
+    if (ret < 0)
     {
-      newfp_str = (struct framephy_struct *)malloc(sizeof(struct framephy_struct));
-      newfp_str->fpn = fpn;
-      newfp_str->owner = caller->mm;
-      if (!*frm_lst)
-        *frm_lst = newfp_str;
-      else
+      /* Not enough frames, give back the ones obtained so far */
+      while (*frm_lst != NULL)
       {
-        newfp_str->fp_next = *frm_lst;
-        *frm_lst = newfp_str;
+        newfp_str = *frm_lst;
+        *frm_lst = newfp_str->fp_next;
+        MEMPHY_put_freefp(caller->mram, newfp_str->fpn);
+        free(newfp_str);
       }
-      newfp_str->fp_next = caller->mram->used_fp_list;
-      caller->mram->used_fp_list = newfp_str;
+      return ret;
     }
-    // TODO: ERROR CODE of obtaining somes but not enough frames
-    else
-    {
-      int victim_fpn, victim_pgn, victim_pte;
-      int swpfpn = -1;
-      if (find_victim_page(caller->mm, &victim_pgn) < 0)
-        return -1;
-      victim_pte = caller->mm->pgd[victim_pgn];
-      victim_fpn = PAGING_FPN(victim_pte);
-      newfp_str = (struct framephy_struct *)malloc(sizeof(struct framephy_struct));
-      newfp_str->fpn = victim_fpn;
-      newfp_str->owner = caller->mm;
-      if (!*frm_lst)
-        *frm_lst = newfp_str;
-      else
-      {
-        newfp_str->fp_next = *frm_lst;
-        *frm_lst = newfp_str;
-      }
 
-      // TODO: 11/04/2025 Tiến hành swap
-      int i = 0;
-      if (MEMPHY_get_freefp(caller->active_mswp, &swpfpn) == 0)
-      {
-        __swap_cp_page(caller->mram, victim_fpn, caller->active_mswp, swpfpn);
-        struct memphy_struct *mswp = (struct memphy_struct *)caller->mswp;
-        for (i = 0; i < PAGING_MAX_MMSWP; i++)
-        {
-          if (mswp + i == caller->active_mswp)
-            break;
-        }
-      }
-      else
-      {
-        struct memphy_struct *mswp = (struct memphy_struct *)caller->mswp;
-        for (i = 0; i < PAGING_MAX_MMSWP; i++)
-        {
-          if (MEMPHY_get_freefp(mswp + i, &swpfpn) == 0)
-          {
-            __swap_cp_page(caller->mram, victim_fpn, mswp + i, swpfpn);
-            break;
-          }
-        }
-      }
-      if (swpfpn == -1)
-        return -3000;
-      pte_set_swap(&caller->mm->pgd[victim_pgn], i, swpfpn);
-    }
+    /* A reused frame may still hold the data of its previous page */
+    __zero_fill_page(caller->mram, fpn);
+
+    newfp_str = (struct framephy_struct *)malloc(sizeof(struct framephy_struct));
+    newfp_str->fpn = fpn;
+    newfp_str->owner = caller->mm;
+    newfp_str->fp_next = *frm_lst;
+    *frm_lst = newfp_str;
   }
   return 0;
 }
@@ -226,6 +425,7 @@ int alloc_pages_range(struct pcb_t *caller, int req_pgnum, struct framephy_struc
 int vm_map_ram(struct pcb_t *caller, int astart, int aend, int mapstart, int incpgnum, struct vm_rg_struct *ret_rg)
 {
   struct framephy_struct *frm_lst = NULL;
+  struct framephy_struct *fpit;
   int ret_alloc;
 
   /*@bksysnet: author provides a feasible solution of getting frames
@@ -253,6 +453,13 @@ int vm_map_ram(struct pcb_t *caller, int astart, int aend, int mapstart, int inc
    * do the swaping all to swapper to get the all in ram */
   vmap_page_range(caller, mapstart, incpgnum, frm_lst, ret_rg);
 
+  while (frm_lst != NULL)
+  {
+    fpit = frm_lst;
+    frm_lst = frm_lst->fp_next;
+    free(fpit);
+  }
+
   return 0;
 }
 
@@ -280,6 +487,20 @@ int __swap_cp_page(struct memphy_struct *mpsrc, int srcfpn,
   return 0;
 }
 
+/* Clear the content of a frame
+ * @mp  : memphy
+ * @fpn : physical page number (FPN)
+ **/
+int __zero_fill_page(struct memphy_struct *mp, int fpn)
+{
+  int cellidx;
+
+  for (cellidx = 0; cellidx < PAGING_PAGESZ; cellidx++)
+    MEMPHY_write(mp, fpn * PAGING_PAGESZ + cellidx, 0);
+
+  return 0;
+}
+
 /*
  *Initialize a empty Memory Management instance
  * @mm:     self mm
@@ -289,27 +510,412 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
 {
   struct vm_area_struct *vma0 = malloc(sizeof(struct vm_area_struct));
 
-  mm->pgd = malloc(PAGING_MAX_PGN * sizeof(uint32_t));
+  /* No page is mapped yet, neither present nor swapped */
+  mm->pgd = calloc(PAGING_MAX_PGN, sizeof(uint32_t));
+  mm->fifo_pgn = NULL;
+  mm->swp_clleft = 0;
+  mm->owned_fpn = -1;
+  mm->nr_pages = 0;
+  mm->symrgtbl = NULL;
+  mm->symrgtbl_nchunk = 0;
 
   /* By default the owner comes with at least one vma */
   vma0->vm_id = 0;
+  vma0->vm_flags = 0;
   vma0->vm_start = 0;
   vma0->vm_end = vma0->vm_start;
   vma0->sbrk = vma0->vm_start;
-  struct vm_rg_struct *first_rg = init_vm_rg(vma0->vm_start, vma0->vm_end);
-  enlist_vm_rg_node(&vma0->vm_freerg_list, first_rg);
 
-  /* TODO update VMA0 next */
-  // vma0->next = ...
-  // TODO: 11/04/2025
+  /* The area is still empty, the free lists get filled as sbrk grows */
+  vma0->vm_freerg_list = NULL;
+  vma0->vm_freerg_last = NULL;
+  memset(vma0->vm_freerg_bins, 0, sizeof(vma0->vm_freerg_bins));
+  vma0->vm_freerg_binmap = 0;
+
   vma0->vm_next = NULL;
   /* Point vma owner backward */
   vma0->vm_mm = mm;
 
-  /* TODO: update mmap */
-  // mm->mmap = ...
-  // TODO: 11/04/2025
-  mm->mmap = vma0;
+  mm->mmap = NULL;
+  mm->mmap_by_addr = NULL;
+  mm->mmap_by_id = NULL;
+  mm->map_count = 0;
+  mm->map_cap = 0;
+  insert_vm_area(mm, vma0);
+
+  mm_register(mm);
+
+  return 0;
+}
+
+/*
+ * mm_register - add an address space to the list of live ones
+ * @mm : initialized mm
+ */
+int mm_register(struct mm_struct *mm)
+{
+  pthread_mutex_lock(&mm_list_lock);
+  mm->mm_next = mm_list;
+  mm_list = mm;
+  pthread_mutex_unlock(&mm_list_lock);
+
+  return 0;
+}
+
+/*
+ * mm_unregister - remove an address space from the list of live ones
+ * @mm : registered mm, about to be torn down
+ */
+int mm_unregister(struct mm_struct *mm)
+{
+  struct mm_struct **pp;
+
+  pthread_mutex_lock(&mm_list_lock);
+  for (pp = &mm_list; *pp != NULL; pp = &(*pp)->mm_next)
+    if (*pp == mm)
+    {
+      *pp = mm->mm_next;
+      break;
+    }
+  pthread_mutex_unlock(&mm_list_lock);
+
+  return 0;
+}
+
+/*
+ * mm_is_registered - whether mm is still live, mm_list_lock held
+ * @mm : address space, possibly already torn down
+ */
+int mm_is_registered(struct mm_struct *mm)
+{
+  struct mm_struct *it;
+
+  for (it = mm_list; it != NULL; it = it->mm_next)
+    if (it == mm)
+      return 1;
+
+  return 0;
+}
+
+/*
+ * __cow_last_mapping - hand a copy-on-write frame over to its last mapping
+ * @mram : MEMRAM device
+ * @fpn  : frame down to a single mapping
+ *
+ * The PTE left is looked up in the live address spaces, starting with
+ * the recorded owner. It loses its COW bit and becomes the frame owner,
+ * so the page is written in place and can be evicted again. Call with
+ * mm_list_lock held.
+ */
+void __cow_last_mapping(struct memphy_struct *mram, int fpn)
+{
+  struct framedesc_struct *fd = &mram->frmtbl[fpn];
+  struct mm_struct *mm;
+  struct vm_area_struct *vma;
+  int pgn, pgn_end;
+
+  /* A single mapping no longer saves anything */
+  fd->flags &= ~FRAME_MERGED;
+
+  if (fd->owner != NULL && PAGING_PAGE_PRESENT(fd->owner->pgd[fd->pgn]) &&
+      PAGING_FPN(fd->owner->pgd[fd->pgn]) == fpn)
+  {
+    CLRBIT(fd->owner->pgd[fd->pgn], PAGING_PTE_COW_MASK);
+    return;
+  }
+
+  for (mm = mm_list; mm != NULL; mm = mm->mm_next)
+  {
+    for (vma = mm->mmap; vma != NULL; vma = vma->vm_next)
+    {
+      pgn_end = DIV_ROUND_UP(vma->vm_end, PAGING_PAGESZ);
+      for (pgn = PAGING_PGN(vma->vm_start); pgn < pgn_end; pgn++)
+      {
+        if (!PAGING_PAGE_PRESENT(mm->pgd[pgn]) || PAGING_FPN(mm->pgd[pgn]) != fpn)
+          continue;
+        CLRBIT(mm->pgd[pgn], PAGING_PTE_COW_MASK);
+        MEMPHY_set_owner(mram, fpn, mm, pgn);
+        return;
+      }
+    }
+  }
+}
+
+static void cow_last_mapping(struct memphy_struct *mram, int fpn)
+{
+  pthread_mutex_lock(&mm_list_lock);
+  __cow_last_mapping(mram, fpn);
+  pthread_mutex_unlock(&mm_list_lock);
+}
+
+/*
+ * dup_mm - clone the address space of caller for a forked child
+ * @dst    : child mm, uninitialized
+ * @caller : parent process
+ *
+ * Frames are not copied: every present page is shared with the child,
+ * write protected in both page tables and reference counted in the frame
+ * table, swap slots of swapped pages are shared the same way.
+ */
+int dup_mm(struct mm_struct *dst, struct pcb_t *caller)
+{
+  struct mm_struct *src = caller->mm;
+  struct memphy_struct *mswp = (struct memphy_struct *)caller->mswp;
+  struct vm_area_struct *vma, *newvma;
+  struct vm_rg_struct *rgit;
+  struct pgn_t *pgit, **pgtail;
+  uint32_t pte;
+  int pgn, chunk;
+
+  dst->pgd = malloc(PAGING_MAX_PGN * sizeof(uint32_t));
+  dst->mmap = NULL;
+  dst->mmap_by_addr = NULL;
+  dst->mmap_by_id = NULL;
+  dst->map_count = 0;
+  dst->map_cap = 0;
+  dst->fifo_pgn = NULL;
+  dst->swp_clleft = 0;
+  dst->owned_fpn = -1; /* the parent keeps owning the frames */
+  dst->nr_pages = src->nr_pages;
+
+  for (pgn = 0; pgn < PAGING_MAX_PGN; pgn++)
+  {
+    pte = src->pgd[pgn];
+    if (PAGING_PAGE_PRESENT(pte) && (pte & PAGING_PTE_SHARED_MASK))
+    {
+      /* Shared memory stays shared, and writable */
+      MEMPHY_ref_frame(caller->mram, PAGING_FPN(pte));
+    }
+    else if (PAGING_PAGE_PRESENT(pte))
+    {
+      SETBIT(pte, PAGING_PTE_COW_MASK);
+      src->pgd[pgn] = pte;
+      MEMPHY_ref_frame(caller->mram, PAGING_FPN(pte));
+    }
+    else if (PAGING_PAGE_SWAPPED(pte) && PAGING_SWPTYP(pte) == PAGING_SWPTYP_ZSWAP)
+    {
+      zswap_ref(PAGING_SWPFPN(pte));
+    }
+    else if (PAGING_PAGE_SWAPPED(pte))
+    {
+      MEMPHY_ref_frame(mswp + PAGING_SWPTYP(pte), PAGING_SWPFPN(pte));
+    }
+    dst->pgd[pgn] = pte;
+  }
+
+  for (vma = src->mmap; vma != NULL; vma = vma->vm_next)
+  {
+    newvma = malloc(sizeof(struct vm_area_struct));
+    *newvma = *vma;
+    newvma->vm_next = NULL;
+    newvma->vm_freerg_list = NULL;
+    newvma->vm_freerg_last = NULL;
+    memset(newvma->vm_freerg_bins, 0, sizeof(newvma->vm_freerg_bins));
+    newvma->vm_freerg_binmap = 0;
+    for (rgit = vma->vm_freerg_list; rgit != NULL; rgit = rgit->rg_next)
+      enlist_vm_freerg_list(newvma, init_vm_rg(rgit->rg_start, rgit->rg_end));
+    insert_vm_area(dst, newvma);
+    if (vma->vm_flags & VM_SHARED)
+      shm_dup(src, vma);
+  }
+
+  dst->symrgtbl_nchunk = src->symrgtbl_nchunk;
+  dst->symrgtbl = calloc(src->symrgtbl_nchunk, sizeof(struct vm_rg_struct *));
+  for (chunk = 0; chunk < src->symrgtbl_nchunk; chunk++)
+  {
+    if (src->symrgtbl[chunk] == NULL)
+      continue;
+    dst->symrgtbl[chunk] = malloc(PAGING_SYMTBL_CHUNK_SZ * sizeof(struct vm_rg_struct));
+    memcpy(dst->symrgtbl[chunk], src->symrgtbl[chunk],
+           PAGING_SYMTBL_CHUNK_SZ * sizeof(struct vm_rg_struct));
+  }
+
+  /* Same replacement order as the parent */
+  pgtail = &dst->fifo_pgn;
+  for (pgit = src->fifo_pgn; pgit != NULL; pgit = pgit->pg_next)
+  {
+    *pgtail = malloc(sizeof(struct pgn_t));
+    (*pgtail)->pgn = pgit->pgn;
+    (*pgtail)->pg_next = NULL;
+    pgtail = &(*pgtail)->pg_next;
+  }
+
+  mm_register(dst);
+
+  return 0;
+}
+
+/*
+ * exit_mm - release an address space and everything it holds
+ * @mm     : address space of an exiting process
+ * @caller : exiting process, for its devices
+ *
+ * The frames the process owns are released from its owned list, at a
+ * cost of the owned pages rather than of the page table or of the VM
+ * areas, which demand paging may only have reserved. The pages that list
+ * misses, frames owned by another process and pages swapped out, are
+ * found by a walk of the VM areas that stops at the last of nr_pages. A
+ * frame or swap slot still shared with another process just loses one
+ * reference, shared memory areas are detached.
+ */
+int exit_mm(struct mm_struct *mm, struct pcb_t *caller)
+{
+  struct memphy_struct *mram = caller->mram;
+  struct memphy_struct *mswp = (struct memphy_struct *)caller->mswp;
+  struct vm_area_struct *vma;
+  struct vm_rg_struct *rg;
+  struct pgn_t *pg;
+  uint32_t pte;
+  int pgn, pgn_end, fpn, next, chunk;
+  int left = mm->nr_pages;
+
+  mm_unregister(mm);
+
+  for (vma = mm->mmap; vma != NULL; vma = vma->vm_next)
+    if (vma->vm_flags & VM_SHARED)
+      shm_detach(mram, mm, vma);
+
+  for (fpn = mm->owned_fpn; fpn >= 0; fpn = next)
+  {
+    next = mram->frmtbl[fpn].own_next;
+    pgn = mram->frmtbl[fpn].pgn;
+    MEMPHY_clear_owner(mram, fpn);
+
+    /* The recorded PTE may map another frame by now */
+    pte = mm->pgd[pgn];
+    if (!PAGING_PAGE_PRESENT(pte) || PAGING_FPN(pte) != fpn ||
+        (pte & PAGING_PTE_SHARED_MASK))
+      continue;
+
+    if (MEMPHY_unref_frame(mram, fpn) == 1 && (pte & PAGING_PTE_COW_MASK))
+      cow_last_mapping(mram, fpn);
+    mm->pgd[pgn] = 0;
+    left--;
+  }
+
+  for (vma = mm->mmap; vma != NULL && left > 0; vma = vma->vm_next)
+  {
+    if (vma->vm_flags & VM_SHARED)
+      continue;
+
+    pgn_end = DIV_ROUND_UP(vma->vm_end, PAGING_PAGESZ);
+    for (pgn = PAGING_PGN(vma->vm_start); pgn < pgn_end && left > 0; pgn++)
+    {
+      pte = mm->pgd[pgn];
+      if (PAGING_PAGE_PRESENT(pte))
+      {
+        if (MEMPHY_unref_frame(mram, PAGING_FPN(pte)) == 1 && (pte & PAGING_PTE_COW_MASK))
+          cow_last_mapping(mram, PAGING_FPN(pte));
+      }
+      else if (PAGING_PAGE_SWAPPED(pte) && PAGING_SWPTYP(pte) == PAGING_SWPTYP_ZSWAP)
+        zswap_put(PAGING_SWPFPN(pte));
+      else if (PAGING_PAGE_SWAPPED(pte))
+        MEMPHY_unref_frame(mswp + PAGING_SWPTYP(pte), PAGING_SWPFPN(pte));
+      else
+        continue;
+      left--;
+    }
+  }
+
+  /* Slots reserved for evictions that will not come */
+  while (mm->swp_clleft > 0)
+  {
+    MEMPHY_unref_frame(mswp + mm->swp_cltyp, mm->swp_clnext++);
+    mm->swp_clleft--;
+  }
+
+  while (mm->mmap != NULL)
+  {
+    vma = mm->mmap;
+    mm->mmap = vma->vm_next;
+    while (vma->vm_freerg_list != NULL)
+    {
+      rg = vma->vm_freerg_list;
+      vma->vm_freerg_list = rg->rg_next;
+      free(rg);
+    }
+    free(vma);
+  }
+  free(mm->mmap_by_addr);
+  free(mm->mmap_by_id);
+
+  for (chunk = 0; chunk < mm->symrgtbl_nchunk; chunk++)
+    free(mm->symrgtbl[chunk]);
+  free(mm->symrgtbl);
+
+  while (mm->fifo_pgn != NULL)
+  {
+    pg = mm->fifo_pgn;
+    mm->fifo_pgn = pg->pg_next;
+    free(pg);
+  }
+
+  free(mm->pgd);
+  free(mm);
+
+  return 0;
+}
+
+/*
+ * print_mm_leaks - check at shutdown that exited processes gave back all
+ *                  their frames and swap slots
+ * @mram : MEMRAM device
+ * @mswp : array of the swap devices
+ */
+int print_mm_leaks(struct memphy_struct *mram, struct memphy_struct *mswp)
+{
+  int ram_used, shm_used, swp_used = 0, zswp_used, sit;
+
+  ram_used = mram->maxfpn - mram->free_fp_cnt;
+  shm_used = shm_nframes();
+  for (sit = 0; sit < PAGING_MAX_MMSWP; sit++)
+    swp_used += mswp[sit].maxfpn - mswp[sit].free_fp_cnt;
+  zswp_used = zswap_nentries();
+
+  printf("===== LEAK CHECK =====\n");
+  printf("MEMRAM frames in use: %d (shared memory segments: %d)\n", ram_used, shm_used);
+  printf("swap slots in use: %d, zswap entries: %d\n", swp_used, zswp_used);
+  if (ram_used != shm_used || swp_used != 0 || zswp_used != 0)
+  {
+    printf("LEAK: memory not returned by exited processes\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * do_cow_page - resolve a write to a copy-on-write page
+ * @caller : caller
+ * @pgn    : present page with PAGING_PTE_COW_MASK set
+ * @retfpn : returned frame, now private to caller
+ */
+int do_cow_page(struct pcb_t *caller, int pgn, int *retfpn)
+{
+  uint32_t *pte = &caller->mm->pgd[pgn];
+  int oldfpn = PAGING_FPN(*pte);
+  int newfpn;
+
+  mm_stat.cow_fault++;
+
+  /* The last sharer simply takes the frame over */
+  if (MEMPHY_frame_refcnt(caller->mram, oldfpn) > 1)
+  {
+    /* oldfpn is pinned by its other mappings while a victim is searched */
+    if (get_free_frame(caller, &newfpn) < 0)
+      return -1;
+
+    __swap_cp_page(caller->mram, oldfpn, caller->mram, newfpn);
+    ksm_cow_copy(caller->mram, oldfpn);
+    if (MEMPHY_unref_frame(caller->mram, oldfpn) == 1)
+      cow_last_mapping(caller->mram, oldfpn);
+    pte_set_fpn(pte, newfpn);
+    mm_stat.cow_copy++;
+  }
+  MEMPHY_set_owner(caller->mram, PAGING_FPN(*pte), caller->mm, pgn);
+
+  CLRBIT(*pte, PAGING_PTE_COW_MASK);
+  *retfpn = PAGING_FPN(*pte);
 
   return 0;
 }
@@ -321,6 +927,9 @@ struct vm_rg_struct *init_vm_rg(int rg_start, int rg_end)
   rgnode->rg_start = rg_start;
   rgnode->rg_end = rg_end;
   rgnode->rg_next = NULL;
+  rgnode->rg_prev = NULL;
+  rgnode->rg_bin_next = NULL;
+  rgnode->rg_bin_prev = NULL;
 
   return rgnode;
 }
@@ -344,6 +953,27 @@ int enlist_pgn_node(struct pgn_t **plist, int pgn)
   return 0;
 }
 
+/*
+ * delist_pgn_node - drop a page from a replacement list
+ * @plist : list head
+ * @pgn   : page number
+ */
+int delist_pgn_node(struct pgn_t **plist, int pgn)
+{
+  struct pgn_t *pnode;
+
+  for (; *plist != NULL; plist = &(*plist)->pg_next)
+    if ((*plist)->pgn == pgn)
+    {
+      pnode = *plist;
+      *plist = pnode->pg_next;
+      free(pnode);
+      return 0;
+    }
+
+  return -1;
+}
+
 int print_list_fp(struct framephy_struct *ifp)
 {
   struct framephy_struct *fp = ifp;
@@ -452,4 +1082,35 @@ int print_pgtbl(struct pcb_t *caller, uint32_t start, uint32_t end)
   return 0;
 }
 
+int print_mm_stat(void)
+{
+  unsigned long nsteal = mm_stat.pgsteal_kswapd + mm_stat.pgsteal_direct;
+
+  /* A line shows only for a feature the run used or configured */
+  if (mm_stat.pgfault + mm_stat.pgswapout + mm_stat.cow_fault + nsteal > 0 ||
+      swap_get_cluster() > 1)
+    printf("===== PAGING STATISTICS =====\n");
+  if (mm_stat.pgfault > 0)
+    printf("page faults: %lu (zero-fill %lu)\n", mm_stat.pgfault, mm_stat.pgfault_zero);
+  if (mm_stat.pgswapin + mm_stat.pgswapout > 0)
+  {
+    printf("swap in: %lu, swap out: %lu (clean, not written: %lu)\n",
+           mm_stat.pgswapin, mm_stat.pgswapout, mm_stat.pgswapout_clean);
+    printf("swap slots freed on swap in: %lu\n", mm_stat.swpslot_freed);
+  }
+  if (mm_stat.cow_fault > 0)
+    printf("copy-on-write faults: %lu (copied %lu)\n", mm_stat.cow_fault, mm_stat.cow_copy);
+  if (nsteal > 0)
+    printf("reclaimed by kswapd: %lu, direct: %lu (from other processes: %lu)\n",
+           mm_stat.pgsteal_kswapd, mm_stat.pgsteal_direct, mm_stat.pgsteal_foreign);
+  if (swap_get_cluster() > 1)
+    printf("swap readahead: %lu pages, %lu hits (%.1f%%)\n", mm_stat.ra_pages, mm_stat.ra_hits,
+           mm_stat.ra_pages ? 100.0 * mm_stat.ra_hits / mm_stat.ra_pages : 0.0);
+  print_zswap_stat();
+  print_swapio_stat();
+  print_ksm_stat();
+  print_numa_stat();
+  return 0;
+}
+
 // #endif
@@ -0,0 +1,132 @@
+
+#include "msgq.h"
+#include "timer.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/* Queues are only ever added: a lookup reads the count published after
+ * the queue is set up and needs no lock, creation takes msgq_lock */
+static struct msgq * msgq_table[MSGQ_MAX];
+static int msgq_count = 0;
+static pthread_mutex_t msgq_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct msgq * msgq_find(int key) {
+	int i, n = __atomic_load_n(&msgq_count, __ATOMIC_ACQUIRE);
+
+	for (i = 0; i < n; i++)
+		if (msgq_table[i]->key == key)
+			return msgq_table[i];
+	return NULL;
+}
+
+struct msgq * msgq_get(int key, uint32_t depth) {
+	struct msgq * q;
+	uint32_t size = 1, i;
+
+	if (depth == 0 || depth > MSGQ_MAX_DEPTH)
+		return NULL;
+
+	pthread_mutex_lock(&msgq_lock);
+	q = msgq_find(key);
+	if (q != NULL || msgq_count == MSGQ_MAX) {
+		pthread_mutex_unlock(&msgq_lock);
+		return q;
+	}
+
+	while (size < depth)
+		size <<= 1;
+	q = calloc(1, sizeof(struct msgq));
+	q->key = key;
+	q->mask = size - 1;
+	q->cells = malloc(size * sizeof(struct msgq_cell));
+	/* Cell i is free for the send at position i */
+	for (i = 0; i < size; i++)
+		q->cells[i].seq = i;
+
+	msgq_table[msgq_count] = q;
+	__atomic_store_n(&msgq_count, msgq_count + 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&msgq_lock);
+	return q;
+}
+
+/* A sender owns position pos once it moves enq_pos past it, the cell is
+ * free when its seq equals pos and is handed to the receiver of pos by
+ * setting seq to pos + 1 */
+int msgq_send(struct msgq * q, uint32_t msg) {
+	struct msgq_cell * cell;
+	uint64_t pos = __atomic_load_n(&q->enq_pos, __ATOMIC_RELAXED);
+	int64_t dif;
+
+	while (1) {
+		cell = &q->cells[pos & q->mask];
+		dif = (int64_t)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - pos);
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&q->enq_pos, &pos, pos + 1,
+			    0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (dif < 0) {
+			/* The receiver of the last lap did not take it yet */
+			__atomic_fetch_add(&q->nfull, 1, __ATOMIC_RELAXED);
+			return -1;
+		} else {
+			pos = __atomic_load_n(&q->enq_pos, __ATOMIC_RELAXED);
+		}
+	}
+
+	cell->msg = msg;
+	__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+
+	if (__atomic_fetch_add(&q->nsent, 1, __ATOMIC_RELAXED) == 0)
+		__atomic_store_n(&q->first_send, current_time(), __ATOMIC_RELAXED);
+	return 0;
+}
+
+/* The receiver of pos hands the cell to the sender of the next lap */
+int msgq_recv(struct msgq * q, uint32_t * msg) {
+	struct msgq_cell * cell;
+	uint64_t pos = __atomic_load_n(&q->deq_pos, __ATOMIC_RELAXED);
+	int64_t dif;
+
+	while (1) {
+		cell = &q->cells[pos & q->mask];
+		dif = (int64_t)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - (pos + 1));
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&q->deq_pos, &pos, pos + 1,
+			    0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (dif < 0) {
+			__atomic_fetch_add(&q->nempty, 1, __ATOMIC_RELAXED);
+			return -1;
+		} else {
+			pos = __atomic_load_n(&q->deq_pos, __ATOMIC_RELAXED);
+		}
+	}
+
+	*msg = cell->msg;
+	__atomic_store_n(&cell->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+
+	__atomic_fetch_add(&q->nrecv, 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&q->last_recv, current_time(), __ATOMIC_RELAXED);
+	return 0;
+}
+
+void print_msgq_stat(void) {
+	struct msgq * q;
+	uint64_t first, last, span;
+	unsigned long nrecv;
+	int i;
+
+	for (i = 0; i < msgq_count; i++) {
+		q = msgq_table[i];
+		first = __atomic_load_n(&q->first_send, __ATOMIC_RELAXED);
+		last = __atomic_load_n(&q->last_recv, __ATOMIC_RELAXED);
+		nrecv = __atomic_load_n(&q->nrecv, __ATOMIC_RELAXED);
+		span = last >= first ? last - first + 1 : 0;
+		printf("msgq %d: depth %u, %lu sent, %lu received, %lu full, %lu empty, %.2f msg/slot\n",
+			q->key, q->mask + 1, __atomic_load_n(&q->nsent, __ATOMIC_RELAXED), nrecv,
+			__atomic_load_n(&q->nfull, __ATOMIC_RELAXED),
+			__atomic_load_n(&q->nempty, __ATOMIC_RELAXED),
+			span && nrecv ? (double)nrecv / span : 0.0);
+	}
+}
@@ -3,7 +3,10 @@
 #include "timer.h"
 #include "sched.h"
 #include "loader.h"
+#include "msgq.h"
+#include "futex.h"
 #include "mm.h"
+#include "libmem.h"
 
 #include <pthread.h>
 #include <stdio.h>
@@ -27,6 +30,25 @@ struct mmpaging_ld_args {
 	int active_mswp_id;
 	struct timer_id_t  *timer_id;
 };
+
+/* Same page merging scanner, resident pages looked at per time slot */
+static int ksm_pages = 0;
+/* Reclaim daemon watermarks in free MEMRAM frames, 0 disables it */
+static int wmark_low = 0;
+static int wmark_high = 0;
+/* Memory nodes and the cycles of an access to a remote one */
+static int numa_nodes = 1;
+static int numa_remote = 1;
+/* Queue depth of each swap device, 0 writes pages out synchronously */
+static int swapio_depth = 0;
+/* Tells the memory kernel threads to exit once the CPUs are done */
+static int kthread_stop = 0;
+
+struct kthread_args {
+	struct memphy_struct *mram;
+	struct memphy_struct *mswp;
+	struct timer_id_t *timer_id;
+};
 #endif
 
 static struct ld_args{
@@ -35,6 +57,9 @@ static struct ld_args{
 #ifdef MLQ_SCHED
 	unsigned long * prio;
 #endif
+	/* Deadline class request, 0 0 for none */
+	unsigned int * deadline;
+	unsigned int * budget;
 } ld_processes;
 int num_processes;
 
@@ -49,34 +74,40 @@ static void * cpu_routine(void * args) {
 	int id = ((struct cpu_args*)args)->id;
 	/* Check for new process in ready queue */
 	int time_left = 0;
+	int quantum = 0;
+	int preempted = 0;
 	struct pcb_t * proc = NULL;
 	while (1) {
 		/* Check the status of current process */
 		if (proc == NULL) {
 			/* No process is running, the we load new process from
 		 	* ready queue */
-			proc = get_proc();
-			if (proc == NULL) {
-                           next_slot(timer_id);
-                           continue; /* First load failed. skip dummy load */
-                        }
-		}else if (proc->pc == proc->code->size) {
+			proc = get_proc(id);
+		}else if (proc->pc == proc->code->size || proc->killed) {
 			/* The porcess has finish it job */
-			printf("\tCPU %d: Processed %2d has finished\n",
-				id ,proc->pid);
-			free(proc);
-			proc = get_proc();
+			if (proc->killed)
+				printf("\tCPU %d: Process %2d torn down, killed\n",
+					id, proc->pid);
+			else
+				printf("\tCPU %d: Processed %2d has finished\n",
+					id ,proc->pid);
+			sched_exit(proc);
+#ifdef MM_PAGING
+			free_pcb_memph(proc);
+#endif
+			free_pcb(proc);
+			proc = get_proc(id);
 			time_left = 0;
 		}else if (time_left == 0) {
 			/* The process has done its job in current time slot */
 			printf("\tCPU %d: Put process %2d to run queue\n",
 				id, proc->pid);
-			put_proc(proc);
-			proc = get_proc();
+			put_proc(proc, !preempted);
+			proc = get_proc(id);
 		}
 		
 		/* Recheck process status after loading new process */
-		if (proc == NULL && done) {
+		if (proc == NULL && done && !sched_has_blocked()) {
 			/* No process to run, exit */
 			printf("\tCPU %d stopped\n", id);
 			break;
@@ -88,23 +119,91 @@ static void * cpu_routine(void * args) {
 		}else if (time_left == 0) {
 			printf("\tCPU %d: Dispatched process %2d\n",
 				id, proc->pid);
-			time_left = time_slot;
+			quantum = time_left = sched_quantum(proc);
+			preempted = 0;
 		}
 		
-		/* Run current process */
-		run(proc);
-		time_left--;
+		/* Run current process slot after slot until its quantum ends or
+		 * it finishes, only asking the scheduler whether something more
+		 * urgent waits. A migrated process first refills the cache.
+		 * A process waiting for a device leaves the CPU, or holds it
+		 * for the device time when I/O does not block. A killed process
+		 * runs no further. */
+		while (1) {
+			if (__atomic_load_n(&proc->killed, __ATOMIC_RELAXED))
+				break;
+			if (proc->mig_stall > 0)
+				proc->mig_stall--;
+			else if (proc->io_slots > 0)
+				proc->io_slots--; /* spinning on the device */
+			else
+				run(proc);
+			time_left--;
+			next_slot(timer_id);
+			if (sched_sleep(proc)) {
+				printf("\tCPU %d: Process %2d blocked\n",
+					id, proc->pid);
+				proc = NULL;
+				time_left = 0;
+				break;
+			}
+			if (time_left == 0 || proc->pc == proc->code->size)
+				break;
+			if (sched_need_resched(proc, quantum - time_left)) {
+				time_left = 0;
+				preempted = 1;
+				break;
+			}
+		}
+	}
+	detach_event(timer_id);
+	pthread_exit(NULL);
+}
+
+#ifdef MM_PAGING
+static void * ksm_routine(void * args) {
+	struct memphy_struct * mram = ((struct kthread_args *)args)->mram;
+	struct timer_id_t * timer_id = ((struct kthread_args *)args)->timer_id;
+
+	while (!kthread_stop) {
+		ksm_scan(mram, ksm_pages);
+		next_slot(timer_id);
+	}
+	detach_event(timer_id);
+	pthread_exit(NULL);
+}
+
+static void * swapio_routine(void * args) {
+	struct timer_id_t * timer_id = ((struct kthread_args *)args)->timer_id;
+
+	while (!kthread_stop) {
+		swapio_service();
+		next_slot(timer_id);
+	}
+	detach_event(timer_id);
+	pthread_exit(NULL);
+}
+
+static void * kswapd_routine(void * args) {
+	struct memphy_struct * mram = ((struct kthread_args *)args)->mram;
+	struct memphy_struct * mswp = ((struct kthread_args *)args)->mswp;
+	struct timer_id_t * timer_id = ((struct kthread_args *)args)->timer_id;
+
+	while (!kthread_stop) {
+		kswapd_balance(mram, mswp, wmark_low, wmark_high);
 		next_slot(timer_id);
 	}
 	detach_event(timer_id);
 	pthread_exit(NULL);
 }
+#endif
 
 static void * ld_routine(void * args) {
 #ifdef MM_PAGING
 	struct memphy_struct* mram = ((struct mmpaging_ld_args *)args)->mram;
 	struct memphy_struct** mswp = ((struct mmpaging_ld_args *)args)->mswp;
 	struct memphy_struct* active_mswp = ((struct mmpaging_ld_args *)args)->active_mswp;
+	int active_mswp_id = ((struct mmpaging_ld_args *)args)->active_mswp_id;
 	struct timer_id_t * timer_id = ((struct mmpaging_ld_args *)args)->timer_id;
 #else
 	struct timer_id_t * timer_id = (struct timer_id_t*)args;
@@ -116,6 +215,8 @@ static void * ld_routine(void * args) {
 #ifdef MLQ_SCHED
 		proc->prio = ld_processes.prio[i];
 #endif
+		proc->dl_deadline = ld_processes.deadline[i];
+		proc->dl_budget = ld_processes.budget[i];
 		while (current_time() < ld_processes.start_time[i]) {
 			next_slot(timer_id);
 		}
@@ -125,21 +226,214 @@ static void * ld_routine(void * args) {
 		proc->mram = mram;
 		proc->mswp = mswp;
 		proc->active_mswp = active_mswp;
+		proc->active_mswp_id = active_mswp_id;
 #endif
 		printf("\tLoaded a process at %s, PID: %d PRIO: %ld\n",
 			ld_processes.path[i], proc->pid, ld_processes.prio[i]);
-		add_proc(proc);
+		if (add_proc(proc) < 0) {
+			printf("\tProcess %d dropped, no room in its ready queue\n", proc->pid);
+#ifdef MM_PAGING
+			free_pcb_memph(proc);
+#endif
+			free_pcb(proc);
+		}
 		free(ld_processes.path[i]);
 		i++;
 		next_slot(timer_id);
 	}
 	free(ld_processes.path);
 	free(ld_processes.start_time);
+	free(ld_processes.deadline);
+	free(ld_processes.budget);
 	done = 1;
 	detach_event(timer_id);
 	pthread_exit(NULL);
 }
 
+/* Optional tuning lines after the process list, one [KEY] [value] each:
+ *   PAGESZ <bytes>   page size, power of two in 256..65536 (default 256)
+ *   DEMAND on|off    map frames at first touch rather than at alloc
+ *                    (default off unless built with MM_DEMAND_PAGING)
+ *   ZSWAP <bytes>    compressed swap pool in front of MEMSWP (default off)
+ *   KSM <pages>      resident pages scanned for merging per slot (default off)
+ *   SWPPRIO <id> <prio>  priority of swap device id, higher used first
+ *   WMARK <low> <high>   free frame watermarks of the reclaim daemon
+ *   READAHEAD <pages>    swap-out cluster and swap-in readahead window
+ *   REPLACE global|local page replacement among all processes (default)
+ *                        or within the faulting one
+ *   NUMA <nodes> <cost>  split MEMRAM and the CPUs into memory nodes, an
+ *                        access to a remote node costs <cost> cycles
+ *   IOLAT <slots> block|spin  time slots a page transfer with MEMSWP
+ *                        takes (default 0), the waiting process leaves
+ *                        its CPU or holds it meanwhile
+ *   SWAPIO <depth>       queue up to <depth> page-outs per swap device,
+ *                        written behind the evicting process (default 0)
+ *   SCHED mlq|cfs        scheduling policy (default mlq)
+ *   MIGCOST <slots>      time slots a process loses when dispatched on
+ *                        another CPU than the last one (default 0)
+ *   QUANTUM <lo> <hi> <slots>  time slots per dispatch of prio lo..hi,
+ *                        other prio keep the time slice of the first line
+ *   AGING <slots> <penalty>  MLQ priority aging: one level up per <slots>
+ *                        slots waited, <penalty> levels down for a full
+ *                        time slice (default off)
+ */
+static void read_config_opts(FILE * file, const char * path) {
+	char key[32];
+
+	while (fscanf(file, "%31s", key) == 1) {
+		if (strcmp(key, "SCHED") == 0) {
+			char policy[16];
+			if (fscanf(file, "%15s", policy) != 1
+			    || (strcmp(policy, "mlq") && strcmp(policy, "cfs"))) {
+				printf("Invalid SCHED in %s\n", path);
+				exit(1);
+			}
+			sched_set_policy(strcmp(policy, "cfs") == 0
+				? SCHED_POLICY_CFS : SCHED_POLICY_MLQ);
+			continue;
+		}
+		if (strcmp(key, "QUANTUM") == 0) {
+			int prio_lo, prio_hi, slots;
+			if (fscanf(file, "%d %d %d", &prio_lo, &prio_hi, &slots) != 3
+			    || sched_set_quantum(prio_lo, prio_hi, slots) != 0) {
+				printf("Invalid QUANTUM in %s\n", path);
+				exit(1);
+			}
+			continue;
+		}
+		if (strcmp(key, "AGING") == 0) {
+			int slots, penalty;
+			if (fscanf(file, "%d %d", &slots, &penalty) != 2
+			    || sched_set_aging(slots, penalty) != 0) {
+				printf("Invalid AGING in %s\n", path);
+				exit(1);
+			}
+			continue;
+		}
+		if (strcmp(key, "MIGCOST") == 0) {
+			int slots;
+			if (fscanf(file, "%d", &slots) != 1 || slots < 0) {
+				printf("Invalid MIGCOST in %s\n", path);
+				exit(1);
+			}
+			sched_set_migration_cost(slots);
+			continue;
+		}
+#ifdef MM_PAGING
+		if (strcmp(key, "PAGESZ") == 0) {
+			unsigned int pgsz;
+			if (fscanf(file, "%u", &pgsz) != 1
+			    || paging_set_pagesz(pgsz) != 0) {
+				printf("Invalid PAGESZ in %s\n", path);
+				exit(1);
+			}
+			continue;
+		}
+		if (strcmp(key, "DEMAND") == 0) {
+			char mode[16];
+			if (fscanf(file, "%15s", mode) != 1
+			    || (strcmp(mode, "on") && strcmp(mode, "off"))) {
+				printf("Invalid DEMAND in %s\n", path);
+				exit(1);
+			}
+			paging_set_demand(strcmp(mode, "on") == 0);
+			continue;
+		}
+		if (strcmp(key, "ZSWAP") == 0) {
+			unsigned long poolsz;
+			if (fscanf(file, "%lu", &poolsz) != 1) {
+				printf("Invalid ZSWAP in %s\n", path);
+				exit(1);
+			}
+			zswap_init(poolsz);
+			continue;
+		}
+		if (strcmp(key, "SWPPRIO") == 0) {
+			int swpid, prio;
+			if (fscanf(file, "%d %d", &swpid, &prio) != 2
+			    || swap_set_prio(swpid, prio) != 0) {
+				printf("Invalid SWPPRIO in %s\n", path);
+				exit(1);
+			}
+			continue;
+		}
+		if (strcmp(key, "WMARK") == 0) {
+			if (fscanf(file, "%d %d", &wmark_low, &wmark_high) != 2
+			    || wmark_low <= 0 || wmark_high < wmark_low) {
+				printf("Invalid WMARK in %s\n", path);
+				exit(1);
+			}
+			continue;
+		}
+		if (strcmp(key, "READAHEAD") == 0) {
+			int npages;
+			if (fscanf(file, "%d", &npages) != 1
+			    || swap_set_cluster(npages) != 0) {
+				printf("Invalid READAHEAD in %s\n", path);
+				exit(1);
+			}
+			continue;
+		}
+		if (strcmp(key, "REPLACE") == 0) {
+			char scope[16];
+			if (fscanf(file, "%15s", scope) != 1
+			    || (strcmp(scope, "global") && strcmp(scope, "local"))) {
+				printf("Invalid REPLACE in %s\n", path);
+				exit(1);
+			}
+			vmscan_set_global(strcmp(scope, "global") == 0);
+			continue;
+		}
+		if (strcmp(key, "NUMA") == 0) {
+			if (fscanf(file, "%d %d", &numa_nodes, &numa_remote) != 2
+			    || numa_nodes < 1 || numa_nodes > MEMPHY_MAX_NODES
+			    || numa_remote < 1) {
+				printf("Invalid NUMA in %s\n", path);
+				exit(1);
+			}
+			continue;
+		}
+		if (strcmp(key, "IOLAT") == 0) {
+			char mode[16];
+			int slots;
+			if (fscanf(file, "%d %15s", &slots, mode) != 2
+			    || swap_set_latency(slots) != 0
+			    || (strcmp(mode, "block") && strcmp(mode, "spin"))) {
+				printf("Invalid IOLAT in %s\n", path);
+				exit(1);
+			}
+			sched_set_io_block(strcmp(mode, "block") == 0);
+			continue;
+		}
+		if (strcmp(key, "SWAPIO") == 0) {
+			if (fscanf(file, "%d", &swapio_depth) != 1
+			    || swapio_depth < 0 || swapio_depth > SWAPIO_QDEPTH_MAX) {
+				printf("Invalid SWAPIO in %s\n", path);
+				exit(1);
+			}
+			continue;
+		}
+		if (strcmp(key, "KSM") == 0) {
+			if (fscanf(file, "%d", &ksm_pages) != 1 || ksm_pages < 0) {
+				printf("Invalid KSM in %s\n", path);
+				exit(1);
+			}
+			continue;
+		}
+#endif
+		printf("Unknown config key %s in %s\n", key, path);
+		exit(1);
+	}
+
+#ifdef MM_PAGING
+	if (memramsz / PAGING_PAGESZ > PAGING_MAX_FPN) {
+		printf("MEMRAM of %d bytes needs a page size above %d\n",
+			memramsz, PAGING_PAGESZ);
+		exit(1);
+	}
+#endif
+}
+
 static void read_config(const char * path) {
 	FILE * file;
 	if ((file = fopen(path, "r")) == NULL) {
@@ -147,9 +441,14 @@ static void read_config(const char * path) {
 		exit(1);
 	}
 	fscanf(file, "%d %d %d\n", &time_slot, &num_cpus, &num_processes);
+	sched_set_default_quantum(time_slot);
 	ld_processes.path = (char**)malloc(sizeof(char*) * num_processes);
 	ld_processes.start_time = (unsigned long*)
 		malloc(sizeof(unsigned long) * num_processes);
+	ld_processes.deadline = (unsigned int*)
+		malloc(sizeof(unsigned int) * num_processes);
+	ld_processes.budget = (unsigned int*)
+		malloc(sizeof(unsigned int) * num_processes);
 #ifdef MM_PAGING
 	int sit;
 #ifdef MM_FIXED_MEMSZ
@@ -179,19 +478,41 @@ static void read_config(const char * path) {
 	ld_processes.prio = (unsigned long*)
 		malloc(sizeof(unsigned long) * num_processes);
 #endif
-	int i;
+	/* A process line may end with [deadline] [budget] in time slots to
+	 * ask for the deadline class */
+	int i, nfields, nbase;
+	char line[256];
 	for (i = 0; i < num_processes; i++) {
 		ld_processes.path[i] = (char*)malloc(sizeof(char) * 100);
 		ld_processes.path[i][0] = '\0';
 		strcat(ld_processes.path[i], "input/proc/");
 		char proc[100];
+		ld_processes.deadline[i] = ld_processes.budget[i] = 0;
+		while (fgets(line, sizeof(line), file) != NULL
+		       && line[strspn(line, " \t\r\n")] == '\0')
+			;
 #ifdef MLQ_SCHED
-		fscanf(file, "%lu %s %lu\n", &ld_processes.start_time[i], proc, &ld_processes.prio[i]);
+		nbase = 3;
+		nfields = sscanf(line, "%lu %99s %lu %u %u",
+			&ld_processes.start_time[i], proc, &ld_processes.prio[i],
+			&ld_processes.deadline[i], &ld_processes.budget[i]);
 #else
-		fscanf(file, "%lu %s\n", &ld_processes.start_time[i], proc);
+		nbase = 2;
+		nfields = sscanf(line, "%lu %99s %u %u",
+			&ld_processes.start_time[i], proc,
+			&ld_processes.deadline[i], &ld_processes.budget[i]);
 #endif
+		if ((nfields != nbase && nfields != nbase + 2)
+		    || (nfields == nbase + 2 && (ld_processes.deadline[i] == 0
+		        || ld_processes.budget[i] == 0))) {
+			printf("Invalid process line %d in %s\n", i + 1, path);
+			exit(1);
+		}
 		strcat(ld_processes.path[i], proc);
 	}
+
+	read_config_opts(file, path);
+	fclose(file);
 }
 
 int main(int argc, char * argv[]) {
@@ -218,6 +539,13 @@ int main(int argc, char * argv[]) {
 		args[i].id = i;
 	}
 	struct timer_id_t * ld_event = attach_event();
+#ifdef MM_PAGING
+	pthread_t ksm, kswapd, swapio;
+	struct kthread_args ksm_args, kswapd_args, swapio_args;
+	ksm_args.timer_id = (ksm_pages > 0) ? attach_event() : NULL;
+	kswapd_args.timer_id = (wmark_low > 0) ? attach_event() : NULL;
+	swapio_args.timer_id = (swapio_depth > 0) ? attach_event() : NULL;
+#endif
 	start_timer();
 
 #ifdef MM_PAGING
@@ -229,11 +557,17 @@ int main(int argc, char * argv[]) {
 
 	/* Create MEM RAM */
 	init_memphy(&mram, memramsz, rdmflag);
+	if (numa_nodes > 1
+	    && numa_init(&mram, numa_nodes, num_cpus, numa_remote) != 0) {
+		printf("Cannot split MEMRAM into %d nodes\n", numa_nodes);
+		exit(1);
+	}
 
         /* Create all MEM SWAP */ 
 	int sit;
 	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++)
 	       init_memphy(&mswp[sit], memswpsz[sit], rdmflag);
+	swapio_init(mswp, swapio_depth);
 
 	/* In Paging mode, it needs passing the system mem to each PCB through loader*/
 	struct mmpaging_ld_args *mm_ld_args = malloc(sizeof(struct mmpaging_ld_args));
@@ -247,6 +581,7 @@ int main(int argc, char * argv[]) {
 
 	/* Init scheduler */
 	init_scheduler();
+	sched_set_ncpus(num_cpus);
 
 	/* Run CPU and loader */
 #ifdef MM_PAGING
@@ -258,16 +593,49 @@ int main(int argc, char * argv[]) {
 		pthread_create(&cpu[i], NULL,
 			cpu_routine, (void*)&args[i]);
 	}
+#ifdef MM_PAGING
+	if (ksm_pages > 0) {
+		ksm_args.mram = &mram;
+		pthread_create(&ksm, NULL, ksm_routine, (void*)&ksm_args);
+	}
+	if (wmark_low > 0) {
+		kswapd_args.mram = &mram;
+		kswapd_args.mswp = mswp;
+		pthread_create(&kswapd, NULL, kswapd_routine, (void*)&kswapd_args);
+	}
+	if (swapio_depth > 0)
+		pthread_create(&swapio, NULL, swapio_routine, (void*)&swapio_args);
+#endif
 
 	/* Wait for CPU and loader finishing */
 	for (i = 0; i < num_cpus; i++) {
 		pthread_join(cpu[i], NULL);
 	}
 	pthread_join(ld, NULL);
+#ifdef MM_PAGING
+	kthread_stop = 1;
+	if (ksm_pages > 0)
+		pthread_join(ksm, NULL);
+	if (wmark_low > 0)
+		pthread_join(kswapd, NULL);
+	if (swapio_depth > 0)
+		pthread_join(swapio, NULL);
+	swapio_drain();
+#endif
 
 	/* Stop timer */
 	stop_timer();
 
+	print_sched_stat();
+	print_msgq_stat();
+	print_futex_stat();
+
+#ifdef MM_PAGING
+	print_mm_stat();
+	print_swap_stat(mswp);
+	print_mm_leaks(&mram, mswp);
+#endif
+
 	return 0;
 
 }
@@ -7,10 +7,11 @@ int empty(struct queue_t * q) {
 	return (q->size == 0);
 }
 
-void enqueue(struct queue_t * q, struct pcb_t * proc) {
+int enqueue(struct queue_t * q, struct pcb_t * proc) {
         /* TODO: put a new process to queue [q] */
-        if (!q || !proc || q->size >= MAX_QUEUE_SIZE) return;
+        if (!q || !proc || q->size >= MAX_QUEUE_SIZE) return -1;
         q->proc[q->size++] = proc;
+        return 0;
 }
 
 struct pcb_t * dequeue(struct queue_t * q) {
@@ -27,3 +28,12 @@ struct pcb_t * dequeue(struct queue_t * q) {
         return front;
 }
 
+struct pcb_t * dequeue_at(struct queue_t * q, int index) {
+        if (!q || index < 0 || index >= q->size) return NULL;
+        struct pcb_t * proc = q->proc[index];
+        for (int i = index; i < q->size - 1; i++) {
+                q->proc[i] = q->proc[i + 1];
+        }
+        q->size--;
+        return proc;
+}
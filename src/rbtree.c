@@ -0,0 +1,239 @@
+
+#include "rbtree.h"
+
+/* Red-black tree after CLRS, NULL children stand for the black leaves */
+
+static int is_red(struct rb_node * node) {
+	return node != NULL && node->red;
+}
+
+static void rotate_left(struct rb_root * root, struct rb_node * x) {
+	struct rb_node * y = x->right;
+
+	x->right = y->left;
+	if (y->left != NULL)
+		y->left->parent = x;
+	y->parent = x->parent;
+	if (x->parent == NULL)
+		root->node = y;
+	else if (x == x->parent->left)
+		x->parent->left = y;
+	else
+		x->parent->right = y;
+	y->left = x;
+	x->parent = y;
+}
+
+static void rotate_right(struct rb_root * root, struct rb_node * x) {
+	struct rb_node * y = x->left;
+
+	x->left = y->right;
+	if (y->right != NULL)
+		y->right->parent = x;
+	y->parent = x->parent;
+	if (x->parent == NULL)
+		root->node = y;
+	else if (x == x->parent->right)
+		x->parent->right = y;
+	else
+		x->parent->left = y;
+	y->right = x;
+	x->parent = y;
+}
+
+void rb_insert(struct rb_root * root, struct rb_node * node,
+	int (*less)(const struct rb_node *, const struct rb_node *)) {
+	struct rb_node ** link = &root->node;
+	struct rb_node * parent = NULL;
+	struct rb_node * uncle;
+	int leftmost = 1;
+
+	while (*link != NULL) {
+		parent = *link;
+		if (less(node, parent)) {
+			link = &parent->left;
+		} else {
+			link = &parent->right;
+			leftmost = 0;
+		}
+	}
+
+	node->parent = parent;
+	node->left = node->right = NULL;
+	node->red = 1;
+	*link = node;
+	if (leftmost)
+		root->leftmost = node;
+	root->count++;
+
+	/* Restore: no red node has a red parent */
+	while (is_red(node->parent)) {
+		parent = node->parent;
+		if (parent == parent->parent->left) {
+			uncle = parent->parent->right;
+			if (is_red(uncle)) {
+				parent->red = 0;
+				uncle->red = 0;
+				parent->parent->red = 1;
+				node = parent->parent;
+				continue;
+			}
+			if (node == parent->right) {
+				node = parent;
+				rotate_left(root, node);
+				parent = node->parent;
+			}
+			parent->red = 0;
+			parent->parent->red = 1;
+			rotate_right(root, parent->parent);
+		} else {
+			uncle = parent->parent->left;
+			if (is_red(uncle)) {
+				parent->red = 0;
+				uncle->red = 0;
+				parent->parent->red = 1;
+				node = parent->parent;
+				continue;
+			}
+			if (node == parent->left) {
+				node = parent;
+				rotate_right(root, node);
+				parent = node->parent;
+			}
+			parent->red = 0;
+			parent->parent->red = 1;
+			rotate_left(root, parent->parent);
+		}
+	}
+	root->node->red = 0;
+}
+
+/* Put v in the place of u in u's parent */
+static void transplant(struct rb_root * root, struct rb_node * u, struct rb_node * v) {
+	if (u->parent == NULL)
+		root->node = v;
+	else if (u == u->parent->left)
+		u->parent->left = v;
+	else
+		u->parent->right = v;
+	if (v != NULL)
+		v->parent = u->parent;
+}
+
+static struct rb_node * subtree_min(struct rb_node * node) {
+	while (node->left != NULL)
+		node = node->left;
+	return node;
+}
+
+void rb_erase(struct rb_root * root, struct rb_node * node) {
+	struct rb_node * x, * xparent, * y, * w;
+	int removed_red = node->red;
+
+	if (root->leftmost == node)
+		root->leftmost = rb_next(node);
+	root->count--;
+
+	if (node->left == NULL) {
+		x = node->right;
+		xparent = node->parent;
+		transplant(root, node, x);
+	} else if (node->right == NULL) {
+		x = node->left;
+		xparent = node->parent;
+		transplant(root, node, x);
+	} else {
+		y = subtree_min(node->right);
+		removed_red = y->red;
+		x = y->right;
+		if (y->parent == node) {
+			xparent = y;
+		} else {
+			xparent = y->parent;
+			transplant(root, y, y->right);
+			y->right = node->right;
+			y->right->parent = y;
+		}
+		transplant(root, node, y);
+		y->left = node->left;
+		y->left->parent = y;
+		y->red = node->red;
+	}
+
+	if (removed_red)
+		return;
+
+	/* x carries an extra black, push it up or absorb it */
+	while (x != root->node && !is_red(x)) {
+		if (x == xparent->left) {
+			w = xparent->right;
+			if (is_red(w)) {
+				w->red = 0;
+				xparent->red = 1;
+				rotate_left(root, xparent);
+				w = xparent->right;
+			}
+			if (!is_red(w->left) && !is_red(w->right)) {
+				w->red = 1;
+				x = xparent;
+				xparent = x->parent;
+				continue;
+			}
+			if (!is_red(w->right)) {
+				w->left->red = 0;
+				w->red = 1;
+				rotate_right(root, w);
+				w = xparent->right;
+			}
+			w->red = xparent->red;
+			xparent->red = 0;
+			w->right->red = 0;
+			rotate_left(root, xparent);
+		} else {
+			w = xparent->left;
+			if (is_red(w)) {
+				w->red = 0;
+				xparent->red = 1;
+				rotate_right(root, xparent);
+				w = xparent->left;
+			}
+			if (!is_red(w->left) && !is_red(w->right)) {
+				w->red = 1;
+				x = xparent;
+				xparent = x->parent;
+				continue;
+			}
+			if (!is_red(w->left)) {
+				w->right->red = 0;
+				w->red = 1;
+				rotate_left(root, w);
+				w = xparent->left;
+			}
+			w->red = xparent->red;
+			xparent->red = 0;
+			w->left->red = 0;
+			rotate_right(root, xparent);
+		}
+		x = root->node;
+	}
+	if (x != NULL)
+		x->red = 0;
+}
+
+struct rb_node * rb_first(struct rb_root * root) {
+	return root->leftmost;
+}
+
+struct rb_node * rb_next(struct rb_node * node) {
+	struct rb_node * parent;
+
+	if (node->right != NULL)
+		return subtree_min(node->right);
+
+	parent = node->parent;
+	while (parent != NULL && node == parent->right) {
+		node = parent;
+		parent = node->parent;
+	}
+	return parent;
+}
@@ -1,10 +1,12 @@
 
 #include "queue.h"
 #include "sched.h"
+#include "timer.h"
 #include <pthread.h>
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 static struct queue_t ready_queue;
 static struct queue_t run_queue;
 static pthread_mutex_t queue_lock;
@@ -13,9 +15,119 @@ static struct queue_t running_list; // for syscall killall
 #ifdef MLQ_SCHED
 static struct queue_t mlq_ready_queue[MAX_PRIO];
 static int slot[MAX_PRIO];
+
+/* Aging, off while mlq_age_slots is 0. The prio of a process stays
+ * between 0 and the base prio it was loaded with. */
+static int mlq_age_slots = 0;
+static int mlq_age_penalty = 1;
+static unsigned long mlq_promotions = 0;
+static unsigned long mlq_demotions = 0;
+static unsigned long mlq_spills = 0;	/* queued away from a full level */
+
+/* Bit prio set while mlq_ready_queue[prio] is not empty, written under
+ * queue_lock and read atomically without it */
+#define MLQ_MAP_WORDS ((MAX_PRIO + 63) / 64)
+static uint64_t mlq_ready_map[MLQ_MAP_WORDS];
 #endif
 
+/* Time slots a process runs per dispatch, by prio, 0 for the default */
+static int sched_default_quantum = 1;
+static int sched_quantum_tbl[MAX_PRIO];
+
+static unsigned long sched_nr_calls = 0;   /* get_proc / put_proc with the lock */
+static unsigned long sched_nr_preempt = 0; /* quanta cut short */
+
+static int sched_policy = SCHED_POLICY_MLQ;
+static int sched_ncpus = 32;
+static int sched_migration_cost = 0;
+
+/* CFS timeline: ready processes ordered by vruntime, the leftmost one
+ * runs next. min_vruntime only grows, new processes start there. */
+static struct rb_root cfs_timeline = RB_ROOT_INIT;
+static uint64_t cfs_min_vruntime = 0;
+/* vruntime of the leftmost node, readable without the lock */
+static uint64_t cfs_leftmost_vruntime = UINT64_MAX;
+
+/* Deadline class: admitted processes ordered by absolute deadline, the
+ * earliest one runs ahead of MLQ and CFS. dl_active holds the admitted
+ * processes alive, whose densities budget / deadline admission sums. */
+static struct rb_root dl_timeline = RB_ROOT_INIT;
+/* Deadline of the leftmost node, readable without the lock */
+static uint64_t dl_leftmost_abs = UINT64_MAX;
+static struct pcb_t ** dl_active = NULL;
+static int dl_nactive = 0;
+static int dl_active_cap = 0;
+static unsigned long dl_nr_rejected = 0;
+static unsigned long dl_nr_overrun = 0;
+
+/* Blocked processes: the timed ones on a timeline ordered by wake time,
+ * the others on the wait queue of what they wait for */
+static struct rb_root sleep_timeline = RB_ROOT_INIT;
+/* Wake time of the leftmost sleeper, readable without the lock */
+static uint64_t sleep_next_wake = UINT64_MAX;
+static int sched_nr_blocked = 0;
+static int sched_nr_running = 0; /* processes on a CPU */
+
+/* Every process added and not exited yet */
+static struct pcb_t ** sched_procs = NULL;
+static int sched_nprocs = 0;
+static int sched_procs_cap = 0;
+
+/* Ready queue slots: each process alive must find one whenever it leaves
+ * its CPU or wakes up, so no more may be added */
+#ifdef MLQ_SCHED
+#define SCHED_QUEUE_SLOTS (MAX_PRIO * MAX_QUEUE_SIZE)
+#else
+#define SCHED_QUEUE_SLOTS MAX_QUEUE_SIZE
+#endif
+static int sched_io_block = 1;
+static unsigned long sched_nr_blocks = 0;
+
+static void sched_wake_expired(uint64_t now);
+
+/* Load weight of nice -20 .. 19, each step is about 10% of CPU time */
+static const uint32_t cfs_prio_to_weight[40] = {
+	88761, 71755, 56483, 46273, 36291,
+	29154, 23254, 18705, 14949, 11916,
+	 9548,  7620,  6100,  4904,  3906,
+	 3121,  2501,  1991,  1586,  1277,
+	 1024,   820,   655,   526,   423,
+	  335,   272,   215,   172,   137,
+	  110,    87,    70,    56,    45,
+	   36,    29,    23,    18,    15,
+};
+
+/* Accounting of the finished processes, for print_sched_stat() */
+struct sched_record {
+	uint32_t pid;
+	uint32_t prio;
+	uint32_t weight;
+	uint64_t arrival;
+	uint64_t turnaround;
+	uint64_t response;
+	uint64_t wait;
+	uint64_t run;
+	uint64_t blocked;
+	uint32_t nr_dispatch;
+	uint32_t nr_migrations;
+	uint32_t deadline;	/* relative, 0 outside the deadline class */
+	int dl_admitted;	/* ... and still within budget at exit */
+};
+
+static struct sched_record * sched_records = NULL;
+static int sched_nrecords = 0;
+static int sched_records_cap = 0;
+
+/* Every wait in a ready queue, by base priority */
+static struct {
+	uint32_t * v;
+	int n;
+	int cap;
+} sched_waits[MAX_PRIO];
+
 int queue_empty(void) {
+	if (cfs_timeline.count > 0 || dl_timeline.count > 0)
+		return 0;
 #ifdef MLQ_SCHED
 	unsigned long prio;
 	for (prio = 0; prio < MAX_PRIO; prio++)
@@ -39,26 +151,132 @@ void init_scheduler(void) {
 	pthread_mutex_init(&queue_lock, NULL);
 }
 
+/* The process may run on cpu */
+static int sched_allowed(struct pcb_t * proc, int cpu) {
+	return (proc->affinity >> cpu) & 1;
+}
+
+/* Its cache is still on cpu, or it never ran and has none to lose */
+static int sched_warm(struct pcb_t * proc, int cpu) {
+	return proc->nr_dispatch == 0 || proc->cpu == (uint32_t)cpu;
+}
+
+/* Index of the process of q to run on cpu: the first warm one, else the
+ * first one allowed there, -1 if none is */
+static int queue_pick(struct queue_t * q, int cpu) {
+	int i, first = -1;
+
+	for (i = 0; i < q->size; i++) {
+		if (!sched_allowed(q->proc[i], cpu))
+			continue;
+		if (sched_warm(q->proc[i], cpu))
+			return i;
+		if (first < 0)
+			first = i;
+	}
+	return first;
+}
+
 #ifdef MLQ_SCHED
+/* Call with queue_lock held after the queue of prio changed */
+static void mlq_sync_map(int prio) {
+	uint64_t word = mlq_ready_map[prio / 64];
+
+	if (empty(&mlq_ready_queue[prio]))
+		word &= ~(1ULL << (prio % 64));
+	else
+		word |= 1ULL << (prio % 64);
+	__atomic_store_n(&mlq_ready_map[prio / 64], word, __ATOMIC_RELAXED);
+}
+
+/* Queue proc at its own level or, that queue being full, at the nearest
+ * level with room, lower ones first. It keeps its prio and goes back to
+ * its own level next time. Call with queue_lock held, -1 when every
+ * queue is full. */
+static int mlq_enqueue(struct pcb_t * proc) {
+	int i, prio;
+
+	for (i = 0; i < MAX_PRIO; i++) {
+		/* proc->prio up to the lowest level, then back up to 0 */
+		prio = (int)proc->prio + i < MAX_PRIO
+			? (int)proc->prio + i : MAX_PRIO - 1 - i;
+		if (enqueue(&mlq_ready_queue[prio], proc) == 0) {
+			if (i > 0)
+				mlq_spills++;
+			mlq_sync_map(prio);
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/* Highest priority with a ready process, MAX_PRIO if none. Without
+ * queue_lock the answer is only a hint. */
+static int mlq_top_prio(void) {
+	uint64_t word;
+	int w;
+
+	for (w = 0; w < MLQ_MAP_WORDS; w++) {
+		word = __atomic_load_n(&mlq_ready_map[w], __ATOMIC_RELAXED);
+		if (word != 0)
+			return w * 64 + __builtin_ctzll(word);
+	}
+	return MAX_PRIO;
+}
+
 /* 
  *  Stateful design for routine calling
  *  based on the priority and our MLQ policy
  *  We implement stateful here using transition technique
  *  State representation   prio = 0 .. MAX_PRIO, curr_slot = 0..(MAX_PRIO - prio)
  */
-struct pcb_t * get_mlq_proc(void) {
+/* Move every process up the levels it earned waiting, call with
+ * queue_lock held. A full queue keeps its candidates for later. */
+static void mlq_age(uint64_t now) {
+	struct pcb_t * proc;
+	uint64_t levels;
+	int prio, target, i;
+
+	for (prio = 1; prio < MAX_PRIO; prio++) {
+		for (i = 0; i < mlq_ready_queue[prio].size; i++) {
+			proc = mlq_ready_queue[prio].proc[i];
+			levels = (now - proc->aged_since) / mlq_age_slots;
+			if (levels == 0)
+				continue;
+			if (levels > (uint64_t)prio)
+				levels = prio;
+			target = prio - levels;
+			if (mlq_ready_queue[target].size >= MAX_QUEUE_SIZE)
+				continue;
+
+			dequeue_at(&mlq_ready_queue[prio], i--);
+			proc->prio = target;
+			proc->aged_since += levels * mlq_age_slots;
+			enqueue(&mlq_ready_queue[target], proc);
+			mlq_sync_map(prio);
+			mlq_sync_map(target);
+			mlq_promotions += levels;
+		}
+	}
+}
+
+struct pcb_t * get_mlq_proc(int cpu) {
 	struct pcb_t * proc = NULL;
 	/*TODO: get a process from PRIORITY [ready_queue].
 	 * Remember to use lock to protect the queue.
 	 * */
 	pthread_mutex_lock(&queue_lock);
+	if (mlq_age_slots > 0)
+		mlq_age(current_time());
 	unsigned long prio = 0;
 	unsigned long slot_count = 0;
 	for(int i = 0; i < MAX_PRIO; i++) { // Chạy qua tất cả các hàng đợi
-		if(!empty(&mlq_ready_queue[i]) && slot_count < slot[prio]) {
+		int idx = queue_pick(&mlq_ready_queue[prio], cpu);
+		if(idx >= 0 && slot_count < slot[prio]) {
 			// Hàng đợi tại prio còn slot trống và không rỗng
-			proc = dequeue(&mlq_ready_queue[prio]); // Lấy proc từ hàng đợi tại prio
+			proc = dequeue_at(&mlq_ready_queue[prio], idx); // Lấy proc từ hàng đợi tại prio
 			proc->prio = prio; // Đặt prio cho proc
+			mlq_sync_map(prio);
 			slot_count++;
 			break;
 		}
@@ -71,80 +289,960 @@ struct pcb_t * get_mlq_proc(void) {
 	return proc;	
 }
 
-void put_mlq_proc(struct pcb_t * proc) {
+int put_mlq_proc(struct pcb_t * proc, int expired) {
+	uint32_t prio = proc->prio;
+	int ret;
+
 	pthread_mutex_lock(&queue_lock);
-	enqueue(&mlq_ready_queue[proc->prio], proc);
+	/* The whole time slice was used, fall back toward the base prio */
+	if (expired && mlq_age_slots > 0 && prio < proc->base_prio) {
+		prio += mlq_age_penalty;
+		if (prio > proc->base_prio)
+			prio = proc->base_prio;
+		mlq_demotions += prio - proc->prio;
+		proc->prio = prio;
+	}
+	proc->aged_since = current_time();
+	ret = mlq_enqueue(proc);
 	pthread_mutex_unlock(&queue_lock);
+	return ret;
 }
 
-void add_mlq_proc(struct pcb_t * proc) {
+int add_mlq_proc(struct pcb_t * proc) {
+	int ret;
+
 	pthread_mutex_lock(&queue_lock);
-	enqueue(&mlq_ready_queue[proc->prio], proc);
+	ret = mlq_enqueue(proc);
 	pthread_mutex_unlock(&queue_lock);	
+	return ret;
 }
 
-struct pcb_t * get_proc(void) {
-	return get_mlq_proc();
+#else
+static struct pcb_t * get_fifo_proc(int cpu) {
+	struct pcb_t * proc = NULL;
+	/*TODO: get a process from [ready_queue].
+	 * Remember to use lock to protect the queue.
+	 * */
+	pthread_mutex_lock(&queue_lock);
+	proc = dequeue_at(&ready_queue, queue_pick(&ready_queue, cpu));
+	pthread_mutex_unlock(&queue_lock);
+	return proc;
 }
 
-void put_proc(struct pcb_t * proc) {
-	proc->ready_queue = &ready_queue;
-	proc->mlq_ready_queue = mlq_ready_queue;
-	proc->running_list = & running_list;
+static int put_fifo_proc(struct pcb_t * proc) {
+	int ret;
 
-	/* TODO: put running proc to running_list */
 	pthread_mutex_lock(&queue_lock);
-	enqueue(&running_list, proc);
+	ret = enqueue(&ready_queue, proc);
 	pthread_mutex_unlock(&queue_lock);
+	return ret;
+}
+#endif
 
-	return put_mlq_proc(proc);
+int sched_set_policy(int policy) {
+	if (policy != SCHED_POLICY_MLQ && policy != SCHED_POLICY_CFS)
+		return -1;
+	sched_policy = policy;
+	return 0;
 }
 
-void add_proc(struct pcb_t * proc) {
-	proc->ready_queue = &ready_queue;
-	proc->mlq_ready_queue = mlq_ready_queue;
-	proc->running_list = & running_list;
+void sched_set_ncpus(int ncpus) {
+	sched_ncpus = ncpus;
+}
+
+void sched_set_migration_cost(int slots) {
+	sched_migration_cost = slots;
+}
+
+void sched_set_default_quantum(int slots) {
+	sched_default_quantum = slots;
+}
+
+int sched_set_quantum(int prio_lo, int prio_hi, int slots) {
+	int prio;
+
+	if (prio_lo < 0 || prio_hi >= MAX_PRIO || prio_lo > prio_hi || slots < 1)
+		return -1;
+	for (prio = prio_lo; prio <= prio_hi; prio++)
+		sched_quantum_tbl[prio] = slots;
+	return 0;
+}
+
+int sched_quantum(struct pcb_t * proc) {
+#ifdef MLQ_SCHED
+	uint32_t prio = proc->prio;
+#else
+	uint32_t prio = proc->priority;
+#endif
+
+	/* A deadline process runs on until its budget is used up */
+	if (proc->dl_admitted)
+		return proc->dl_budget > proc->run_time
+			? proc->dl_budget - proc->run_time : 1;
+	if (prio >= MAX_PRIO || sched_quantum_tbl[prio] == 0)
+		return sched_default_quantum;
+	return sched_quantum_tbl[prio];
+}
+
+/* Some process is ready, read without the lock as a hint */
+static int sched_has_ready(void) {
+	if (__atomic_load_n(&dl_leftmost_abs, __ATOMIC_RELAXED) != UINT64_MAX)
+		return 1;
+	if (sched_policy == SCHED_POLICY_CFS)
+		return __atomic_load_n(&cfs_leftmost_vruntime, __ATOMIC_RELAXED) != UINT64_MAX;
+#ifdef MLQ_SCHED
+	return mlq_top_prio() < MAX_PRIO;
+#else
+	return !empty(&ready_queue);
+#endif
+}
+
+int sched_need_resched(struct pcb_t * proc, int ran) {
+	int preempt = 0;
+
+	sched_wake_expired(current_time());
+
+	/* An earlier deadline takes the CPU at once, from any class */
+	if (__atomic_load_n(&dl_leftmost_abs, __ATOMIC_RELAXED)
+	    < (proc->dl_admitted ? proc->dl_abs : UINT64_MAX)) {
+		__atomic_fetch_add(&sched_nr_preempt, 1, __ATOMIC_RELAXED);
+		return 1;
+	}
+	if (proc->dl_admitted)
+		return 0;
+
+	/* A quantum no longer than the default one always runs out */
+	if (ran < sched_default_quantum)
+		return 0;
+
+	if (sched_policy == SCHED_POLICY_CFS) {
+		uint64_t vruntime = proc->vruntime
+			+ (uint64_t)ran * CFS_NICE_0_WEIGHT / proc->weight;
+		uint64_t leftmost = __atomic_load_n(&cfs_leftmost_vruntime, __ATOMIC_RELAXED);
+		preempt = leftmost != UINT64_MAX
+			&& leftmost + CFS_MIGRATE_GRAN < vruntime;
+	}
+#ifdef MLQ_SCHED
+	else {
+		preempt = mlq_top_prio() < (int)proc->prio;
+	}
+#endif
+
+	if (preempt)
+		__atomic_fetch_add(&sched_nr_preempt, 1, __ATOMIC_RELAXED);
+	return preempt;
+}
+
+int sched_set_aging(int slots, int penalty) {
+	if (slots < 0 || penalty < 0)
+		return -1;
+#ifdef MLQ_SCHED
+	mlq_age_slots = slots;
+	mlq_age_penalty = penalty;
+#endif
+	return 0;
+}
+
+/* Priority a process was loaded with */
+static uint32_t sched_base_prio(struct pcb_t * proc) {
+#ifdef MLQ_SCHED
+	return proc->base_prio;
+#else
+	return proc->priority < MAX_PRIO ? proc->priority : MAX_PRIO - 1;
+#endif
+}
+
+/* Call with queue_lock held */
+static void sched_record_wait(struct pcb_t * proc, uint32_t wait) {
+	uint32_t prio = sched_base_prio(proc);
+
+	if (sched_waits[prio].n == sched_waits[prio].cap) {
+		sched_waits[prio].cap = sched_waits[prio].cap
+			? 2 * sched_waits[prio].cap : 16;
+		sched_waits[prio].v = realloc(sched_waits[prio].v,
+			sched_waits[prio].cap * sizeof(uint32_t));
+	}
+	sched_waits[prio].v[sched_waits[prio].n++] = wait;
+}
+
+static struct pcb_t * sched_find_ready(uint32_t pid) {
+	struct rb_node * node;
+	int i;
+#ifdef MLQ_SCHED
+	int prio;
+
+	for (prio = 0; prio < MAX_PRIO; prio++)
+		for (i = 0; i < mlq_ready_queue[prio].size; i++)
+			if (mlq_ready_queue[prio].proc[i]->pid == pid)
+				return mlq_ready_queue[prio].proc[i];
+#endif
+	for (i = 0; i < ready_queue.size; i++)
+		if (ready_queue.proc[i]->pid == pid)
+			return ready_queue.proc[i];
+	for (node = rb_first(&cfs_timeline); node != NULL; node = rb_next(node))
+		if (rb_entry(node, struct pcb_t, sched_node)->pid == pid)
+			return rb_entry(node, struct pcb_t, sched_node);
+	for (node = rb_first(&dl_timeline); node != NULL; node = rb_next(node))
+		if (rb_entry(node, struct pcb_t, sched_node)->pid == pid)
+			return rb_entry(node, struct pcb_t, sched_node);
+	return NULL;
+}
+
+int sched_set_affinity(struct pcb_t * caller, uint32_t pid, uint32_t mask) {
+	struct pcb_t * proc = caller;
+
+	/* At least one of the CPUs must exist */
+	if (sched_ncpus < 32)
+		mask &= (1U << sched_ncpus) - 1;
+	if (mask == 0)
+		return -1;
+
+	pthread_mutex_lock(&queue_lock);
+	if (pid != 0 && pid != caller->pid)
+		proc = sched_find_ready(pid);
+	if (proc != NULL)
+		proc->affinity = mask;
+	pthread_mutex_unlock(&queue_lock);
+
+	return proc != NULL ? 0 : -1;
+}
+
+/* Map prio 0 .. MAX_PRIO - 1 linearly onto nice -20 .. 19 */
+static uint32_t cfs_weight(uint32_t prio) {
+	if (prio >= MAX_PRIO)
+		prio = MAX_PRIO - 1;
+	return cfs_prio_to_weight[prio * 40 / MAX_PRIO];
+}
+
+static int cfs_less(const struct rb_node * a, const struct rb_node * b) {
+	return rb_entry(a, struct pcb_t, sched_node)->vruntime
+		< rb_entry(b, struct pcb_t, sched_node)->vruntime;
+}
+
+/* Call with queue_lock held after the timeline changed */
+static void cfs_sync_leftmost(void) {
+	struct rb_node * node = rb_first(&cfs_timeline);
+
+	__atomic_store_n(&cfs_leftmost_vruntime, node
+		? rb_entry(node, struct pcb_t, sched_node)->vruntime : UINT64_MAX,
+		__ATOMIC_RELAXED);
+}
+
+/* Call with queue_lock held */
+static void cfs_enqueue(struct pcb_t * proc) {
+	struct pcb_t * first;
+
+	rb_insert(&cfs_timeline, &proc->sched_node, cfs_less);
+	first = rb_entry(rb_first(&cfs_timeline), struct pcb_t, sched_node);
+	if (first->vruntime > cfs_min_vruntime)
+		cfs_min_vruntime = first->vruntime;
+	cfs_sync_leftmost();
+}
+
+/* The leftmost process allowed on cpu, or a warm one not lagging it
+ * by more than CFS_MIGRATE_GRAN */
+static struct pcb_t * get_cfs_proc(int cpu) {
+	struct rb_node * node;
+	struct pcb_t * proc, * pick = NULL;
+
+	pthread_mutex_lock(&queue_lock);
+	for (node = rb_first(&cfs_timeline); node != NULL; node = rb_next(node)) {
+		proc = rb_entry(node, struct pcb_t, sched_node);
+		if (!sched_allowed(proc, cpu))
+			continue;
+		if (pick != NULL && proc->vruntime > pick->vruntime + CFS_MIGRATE_GRAN)
+			break;
+		if (pick == NULL)
+			pick = proc;
+		if (sched_warm(proc, cpu)) {
+			pick = proc;
+			break;
+		}
+	}
+	if (pick != NULL) {
+		rb_erase(&cfs_timeline, &pick->sched_node);
+		cfs_sync_leftmost();
+	}
+	pthread_mutex_unlock(&queue_lock);
+
+	return pick;
+}
+
+static void put_cfs_proc(struct pcb_t * proc) {
+	pthread_mutex_lock(&queue_lock);
+	cfs_enqueue(proc);
+	pthread_mutex_unlock(&queue_lock);
+}
+
+static void add_cfs_proc(struct pcb_t * proc) {
+	pthread_mutex_lock(&queue_lock);
+	/* Start level with the others instead of owing them all their run */
+	proc->vruntime = cfs_min_vruntime;
+	cfs_enqueue(proc);
+	pthread_mutex_unlock(&queue_lock);
+}
+
+static int dl_less(const struct rb_node * a, const struct rb_node * b) {
+	return rb_entry(a, struct pcb_t, sched_node)->dl_abs
+		< rb_entry(b, struct pcb_t, sched_node)->dl_abs;
+}
+
+/* Call with queue_lock held after the timeline changed */
+static void dl_sync_leftmost(void) {
+	struct rb_node * node = rb_first(&dl_timeline);
+
+	__atomic_store_n(&dl_leftmost_abs, node
+		? rb_entry(node, struct pcb_t, sched_node)->dl_abs : UINT64_MAX,
+		__ATOMIC_RELAXED);
+}
+
+/* Global EDF on m CPUs meets every deadline when the total density does
+ * not exceed m - (m - 1) * the largest one (Goossens, Funk and Baruah).
+ * With one CPU that is the plain density test. Call with queue_lock
+ * held, affinity masks are not taken into account. */
+static int dl_admit(struct pcb_t * proc) {
+	double density = (double)proc->dl_budget / proc->dl_deadline;
+	double sum = density, max = density;
+	int i;
+
+	if (proc->dl_budget > proc->dl_deadline)
+		return -1;
+	for (i = 0; i < dl_nactive; i++) {
+		density = (double)dl_active[i]->dl_budget / dl_active[i]->dl_deadline;
+		sum += density;
+		if (density > max)
+			max = density;
+	}
+	if (sum > sched_ncpus - (sched_ncpus - 1) * max)
+		return -1;
+
+	if (dl_nactive == dl_active_cap) {
+		dl_active_cap = dl_active_cap ? 2 * dl_active_cap : 16;
+		dl_active = realloc(dl_active, dl_active_cap * sizeof(struct pcb_t *));
+	}
+	dl_active[dl_nactive++] = proc;
+	proc->dl_admitted = 1;
+	return 0;
+}
+
+/* Give the reservation of proc back, call with queue_lock held */
+static void dl_release(struct pcb_t * proc) {
+	int i;
+
+	for (i = 0; i < dl_nactive; i++) {
+		if (dl_active[i] == proc) {
+			dl_active[i] = dl_active[--dl_nactive];
+			break;
+		}
+	}
+	proc->dl_admitted = 0;
+}
+
+/* The earliest deadline allowed on cpu */
+static struct pcb_t * get_dl_proc(int cpu) {
+	struct rb_node * node;
+	struct pcb_t * proc, * pick = NULL;
 
-	/* TODO: put running proc to running_list */
 	pthread_mutex_lock(&queue_lock);
-	enqueue(&running_list, proc);
+	for (node = rb_first(&dl_timeline); node != NULL; node = rb_next(node)) {
+		proc = rb_entry(node, struct pcb_t, sched_node);
+		if (sched_allowed(proc, cpu)) {
+			pick = proc;
+			break;
+		}
+	}
+	if (pick != NULL) {
+		rb_erase(&dl_timeline, &pick->sched_node);
+		dl_sync_leftmost();
+	}
 	pthread_mutex_unlock(&queue_lock);
 
-	return add_mlq_proc(proc);
+	return pick;
 }
+
+/* Queue an admitted process, or drop it to the policy class once it
+ * ran out of budget. Returns 0 when the deadline class took it. */
+static int put_dl_proc(struct pcb_t * proc) {
+	if (!proc->dl_admitted)
+		return -1;
+
+	pthread_mutex_lock(&queue_lock);
+	if (proc->run_time >= proc->dl_budget) {
+		dl_release(proc);
+		dl_nr_overrun++;
+		/* Do not let the CFS class pay back the time it ran */
+		if (proc->vruntime < cfs_min_vruntime)
+			proc->vruntime = cfs_min_vruntime;
+		pthread_mutex_unlock(&queue_lock);
+		return -1;
+	}
+	rb_insert(&dl_timeline, &proc->sched_node, dl_less);
+	dl_sync_leftmost();
+	pthread_mutex_unlock(&queue_lock);
+	return 0;
+}
+
+/* Charge the slots run since the last dispatch */
+static void sched_charge(struct pcb_t * proc) {
+	uint64_t delta = current_time() - proc->exec_start;
+
+	proc->run_time += delta;
+	proc->vruntime += delta * CFS_NICE_0_WEIGHT / proc->weight;
+}
+
+static int sleep_less(const struct rb_node * a, const struct rb_node * b) {
+	return rb_entry(a, struct pcb_t, sched_node)->wake_time
+		< rb_entry(b, struct pcb_t, sched_node)->wake_time;
+}
+
+/* Call with queue_lock held after the timeline changed */
+static void sleep_sync_next(void) {
+	struct rb_node * node = rb_first(&sleep_timeline);
+
+	sleep_next_wake = node
+		? rb_entry(node, struct pcb_t, sched_node)->wake_time : UINT64_MAX;
+}
+
+/* Queue a process back in its class after a block. It does not take
+ * the time slice penalty of put_proc, and CFS credits it at most
+ * CFS_MIGRATE_GRAN for the time it slept. */
+static void sched_enqueue_woken(struct pcb_t * proc) {
+	uint64_t now = current_time();
+
+	proc->blocked_time += now - proc->ready_since;
+	proc->ready_since = now;
+
+	if (put_dl_proc(proc) == 0)
+		return;
+	if (sched_policy == SCHED_POLICY_CFS) {
+		pthread_mutex_lock(&queue_lock);
+		if (proc->vruntime + CFS_MIGRATE_GRAN < cfs_min_vruntime)
+			proc->vruntime = cfs_min_vruntime - CFS_MIGRATE_GRAN;
+		cfs_enqueue(proc);
+		pthread_mutex_unlock(&queue_lock);
+		return;
+	}
+#ifdef MLQ_SCHED
+	proc->aged_since = now;
+	if (add_mlq_proc(proc) == 0)
+		return;
 #else
-struct pcb_t * get_proc(void) {
-	struct pcb_t * proc = NULL;
-	/*TODO: get a process from [ready_queue].
-	 * Remember to use lock to protect the queue.
-	 * */
+	if (put_fifo_proc(proc) == 0)
+		return;
+#endif
+
+	/* No ready queue had room, sleep one more slot and try again */
+	pthread_mutex_lock(&queue_lock);
+	proc->state = PROC_BLOCKED;
+	proc->wake_time = now + 1;
+	rb_insert(&sleep_timeline, &proc->sched_node, sleep_less);
+	sleep_sync_next();
+	sched_nr_blocked++;
+	pthread_mutex_unlock(&queue_lock);
+}
+
+/* Ready the sleepers whose time is up */
+static void sched_wake_expired(uint64_t now) {
+	struct rb_node * node;
+	struct pcb_t * proc;
+
+	while (sleep_next_wake <= now) {
+		proc = NULL;
+		pthread_mutex_lock(&queue_lock);
+		node = rb_first(&sleep_timeline);
+		if (node != NULL
+		    && rb_entry(node, struct pcb_t, sched_node)->wake_time <= now) {
+			proc = rb_entry(node, struct pcb_t, sched_node);
+			rb_erase(&sleep_timeline, node);
+			sleep_sync_next();
+			proc->state = PROC_READY;
+			sched_nr_blocked--;
+		}
+		pthread_mutex_unlock(&queue_lock);
+
+		if (proc == NULL)
+			break;
+		sched_enqueue_woken(proc);
+	}
+}
+
+void sched_block(struct pcb_t * proc, int slots) {
+	pthread_mutex_lock(&queue_lock);
+	proc->state = PROC_BLOCKED;
+	proc->wake_time = current_time() + (slots > 0 ? slots : 1);
+	pthread_mutex_unlock(&queue_lock);
+}
+
+int sched_wait(struct queue_t * wq, struct pcb_t * proc) {
+	int ret = -1;
+
+	pthread_mutex_lock(&queue_lock);
+	if (wq->size < MAX_QUEUE_SIZE) {
+		enqueue(wq, proc);
+		proc->wait_q = wq;
+		proc->state = PROC_BLOCKED;
+		proc->wake_time = 0;
+		ret = 0;
+	}
+	pthread_mutex_unlock(&queue_lock);
+	return ret;
+}
+
+/* Take proc off its wait queue, call with queue_lock held */
+static void sched_wait_remove(struct pcb_t * proc) {
+	struct queue_t * wq = proc->wait_q;
+	int i;
+
+	for (i = 0; i < wq->size; i++) {
+		if (wq->proc[i] == proc) {
+			dequeue_at(wq, i);
+			break;
+		}
+	}
+	proc->wait_q = NULL;
+}
+
+void sched_wait_cancel(struct queue_t * wq, struct pcb_t * proc) {
+	pthread_mutex_lock(&queue_lock);
+	if (proc->wait_q == wq)
+		sched_wait_remove(proc);
+	proc->state = PROC_RUNNING;
+	pthread_mutex_unlock(&queue_lock);
+}
+
+int sched_wake(struct queue_t * wq, int nr) {
+	struct pcb_t * woken[MAX_QUEUE_SIZE];
+	struct pcb_t * proc;
+	int n = 0, nwoken = 0, i;
+
+	pthread_mutex_lock(&queue_lock);
+	while (nwoken < nr && !empty(wq)) {
+		proc = dequeue(wq);
+		proc->wait_q = NULL;
+		proc->state = PROC_READY;
+		nwoken++;
+		/* Still on its CPU, which will see it need not leave */
+		if (proc->on_cpu)
+			continue;
+		sched_nr_blocked--;
+		woken[n++] = proc;
+	}
+	pthread_mutex_unlock(&queue_lock);
+
+	for (i = 0; i < n; i++)
+		sched_enqueue_woken(woken[i]);
+	return nwoken;
+}
+
+int sched_sleep(struct pcb_t * proc) {
+	int parked = 0;
+
+	if (proc->io_slots > 0 && sched_io_block && proc->pc < proc->code->size) {
+		sched_block(proc, proc->io_slots);
+		proc->io_slots = 0;
+	}
+	if (proc->state == PROC_RUNNING)
+		return 0;
+
 	pthread_mutex_lock(&queue_lock);
-	proc = dequeue(&ready_queue);
+	if (proc->state == PROC_BLOCKED) {
+		sched_charge(proc);
+		proc->on_cpu = 0;
+		__atomic_fetch_sub(&sched_nr_running, 1, __ATOMIC_RELAXED);
+		proc->ready_since = current_time();
+		if (proc->wake_time != 0) {
+			rb_insert(&sleep_timeline, &proc->sched_node, sleep_less);
+			sleep_sync_next();
+		}
+		sched_nr_blocked++;
+		sched_nr_blocks++;
+		parked = 1;
+	} else {
+		/* Woken before it left the CPU */
+		proc->state = PROC_RUNNING;
+	}
 	pthread_mutex_unlock(&queue_lock);
+	return parked;
+}
+
+int sched_kill(const char * path, struct pcb_t * caller) {
+	struct pcb_t ** woken, * proc;
+	int i, n = 0, nkilled = 0;
+
+	pthread_mutex_lock(&queue_lock);
+	woken = malloc(sched_nprocs * sizeof(struct pcb_t *));
+	for (i = 0; i < sched_nprocs; i++) {
+		proc = sched_procs[i];
+		if (proc == caller || proc->killed || strcmp(proc->path, path) != 0)
+			continue;
+		__atomic_store_n(&proc->killed, 1, __ATOMIC_RELAXED);
+		nkilled++;
+		printf("\tProcess %d has been killed\n", proc->pid);
+		if (proc->state != PROC_BLOCKED)
+			continue;
+
+		/* Woken up to get to a CPU, which tears it down */
+		if (proc->wait_q != NULL) {
+			sched_wait_remove(proc);
+		} else if (!proc->on_cpu) {
+			rb_erase(&sleep_timeline, &proc->sched_node);
+			sleep_sync_next();
+		}
+		if (proc->on_cpu) {
+			proc->state = PROC_RUNNING;
+			continue;
+		}
+		proc->state = PROC_READY;
+		sched_nr_blocked--;
+		woken[n++] = proc;
+	}
+	pthread_mutex_unlock(&queue_lock);
+
+	for (i = 0; i < n; i++)
+		sched_enqueue_woken(woken[i]);
+	free(woken);
+	return nkilled;
+}
+
+void sched_set_io_block(int block) {
+	sched_io_block = block;
+}
+
+/* A sleeper always wakes, a waiter only while some process runs or is
+ * ready to wake it */
+int sched_has_blocked(void) {
+	if (sleep_next_wake != UINT64_MAX)
+		return 1;
+	return sched_nr_blocked > 0
+		&& (__atomic_load_n(&sched_nr_running, __ATOMIC_RELAXED) > 0
+		    || sched_has_ready());
+}
+
+struct pcb_t * get_proc(int cpu) {
+	struct pcb_t * proc;
+	uint64_t now = current_time();
+
+	sched_wake_expired(now);
+
+	/* An idle CPU polls every slot, keep that off the lock */
+	if (!sched_has_ready())
+		return NULL;
+	__atomic_fetch_add(&sched_nr_calls, 1, __ATOMIC_RELAXED);
+
+	proc = NULL;
+	if (__atomic_load_n(&dl_leftmost_abs, __ATOMIC_RELAXED) != UINT64_MAX)
+		proc = get_dl_proc(cpu);
+	if (proc == NULL) {
+		if (sched_policy == SCHED_POLICY_CFS)
+			proc = get_cfs_proc(cpu);
+		else
+#ifdef MLQ_SCHED
+			proc = get_mlq_proc(cpu);
+#else
+			proc = get_fifo_proc(cpu);
+#endif
+	}
+
+	if (proc != NULL) {
+		if (proc->nr_dispatch++ == 0) {
+			proc->first_run = now;
+		} else if (proc->cpu != (uint32_t)cpu) {
+			proc->nr_migrations++;
+			proc->mig_stall = sched_migration_cost;
+		}
+		proc->cpu = cpu;
+		proc->state = PROC_RUNNING;
+		proc->on_cpu = 1;
+		__atomic_fetch_add(&sched_nr_running, 1, __ATOMIC_RELAXED);
+		proc->wait_time += now - proc->ready_since;
+		proc->exec_start = now;
+
+		pthread_mutex_lock(&queue_lock);
+		sched_record_wait(proc, now - proc->ready_since);
+		pthread_mutex_unlock(&queue_lock);
+	}
 	return proc;
 }
 
-void put_proc(struct pcb_t * proc) {
+/* Drop proc from the processes alive, call with queue_lock held */
+static void sched_forget(struct pcb_t * proc) {
+	int i;
+
+	for (i = 0; i < sched_nprocs; i++) {
+		if (sched_procs[i] == proc) {
+			sched_procs[i] = sched_procs[--sched_nprocs];
+			break;
+		}
+	}
+}
+
+void put_proc(struct pcb_t * proc, int expired) {
 	proc->ready_queue = &ready_queue;
+#ifdef MLQ_SCHED
+	proc->mlq_ready_queue = mlq_ready_queue;
+#endif
 	proc->running_list = & running_list;
 
-	/* TODO: put running proc to running_list */
+	sched_charge(proc);
+	proc->state = PROC_READY;
+	proc->on_cpu = 0;
+	__atomic_fetch_sub(&sched_nr_running, 1, __ATOMIC_RELAXED);
+	proc->ready_since = current_time();
+	__atomic_fetch_add(&sched_nr_calls, 1, __ATOMIC_RELAXED);
 
-	pthread_mutex_lock(&queue_lock);
-	enqueue(&running_list, proc);
-	pthread_mutex_unlock(&queue_lock);
+	if (put_dl_proc(proc) == 0)
+		return;
+	if (sched_policy == SCHED_POLICY_CFS)
+		put_cfs_proc(proc);
+	else
+#ifdef MLQ_SCHED
+		put_mlq_proc(proc, expired);
+#else
+		put_fifo_proc(proc);
+#endif
 }
 
-void add_proc(struct pcb_t * proc) {
+int add_proc(struct pcb_t * proc) {
+	int ret;
+
 	proc->ready_queue = &ready_queue;
+#ifdef MLQ_SCHED
+	proc->mlq_ready_queue = mlq_ready_queue;
+#endif
 	proc->running_list = & running_list;
 
-	/* TODO: put running proc to running_list */
+	pthread_mutex_lock(&queue_lock);
+	if (sched_policy != SCHED_POLICY_CFS && sched_nprocs >= SCHED_QUEUE_SLOTS) {
+		pthread_mutex_unlock(&queue_lock);
+		return -1;
+	}
+	if (sched_nprocs == sched_procs_cap) {
+		sched_procs_cap = sched_procs_cap ? 2 * sched_procs_cap : 16;
+		sched_procs = realloc(sched_procs,
+			sched_procs_cap * sizeof(struct pcb_t *));
+	}
+	sched_procs[sched_nprocs++] = proc;
+	pthread_mutex_unlock(&queue_lock);
+
+#ifdef MLQ_SCHED
+	proc->base_prio = proc->prio;
+	proc->aged_since = current_time();
+	proc->weight = cfs_weight(proc->prio);
+#else
+	proc->weight = cfs_weight(proc->priority);
+#endif
+	proc->arrival_time = proc->ready_since = current_time();
+	proc->first_run = proc->wait_time = proc->run_time = 0;
+	proc->nr_dispatch = proc->nr_migrations = proc->mig_stall = 0;
+	proc->dl_admitted = 0;
+	proc->state = PROC_READY;
+	proc->on_cpu = 0;
+	proc->io_slots = 0;
+	proc->blocked_time = 0;
+	proc->wait_q = NULL;
+	proc->killed = 0;
 
+	if (proc->dl_deadline > 0) {
+		proc->dl_abs = proc->arrival_time + proc->dl_deadline;
+		pthread_mutex_lock(&queue_lock);
+		if (dl_admit(proc) == 0) {
+			rb_insert(&dl_timeline, &proc->sched_node, dl_less);
+			dl_sync_leftmost();
+			pthread_mutex_unlock(&queue_lock);
+			return 0;
+		}
+		dl_nr_rejected++;
+		pthread_mutex_unlock(&queue_lock);
+		printf("	Process %d: deadline %u budget %u not admitted, scheduled as usual\n",
+			proc->pid, proc->dl_deadline, proc->dl_budget);
+	}
+
+	if (sched_policy == SCHED_POLICY_CFS) {
+		add_cfs_proc(proc);
+		return 0;
+	}
+#ifdef MLQ_SCHED
+	ret = add_mlq_proc(proc);
+#else
+	ret = put_fifo_proc(proc);
+#endif
+	if (ret < 0) {
+		/* Not runnable, the caller frees it */
+		pthread_mutex_lock(&queue_lock);
+		sched_forget(proc);
+		pthread_mutex_unlock(&queue_lock);
+	}
+	return ret;
+}
+
+void sched_exit(struct pcb_t * proc) {
+	struct sched_record rec;
+	uint64_t now = current_time();
+
+	sched_charge(proc);
+	proc->state = PROC_ZOMBIE;
+	proc->on_cpu = 0;
+	__atomic_fetch_sub(&sched_nr_running, 1, __ATOMIC_RELAXED);
+
+	rec.pid = proc->pid;
+	rec.prio = sched_base_prio(proc);
+	rec.weight = proc->weight;
+	rec.arrival = proc->arrival_time;
+	rec.turnaround = now - proc->arrival_time;
+	rec.response = proc->first_run - proc->arrival_time;
+	rec.wait = proc->wait_time;
+	rec.run = proc->run_time;
+	rec.blocked = proc->blocked_time;
+	rec.nr_dispatch = proc->nr_dispatch;
+	rec.nr_migrations = proc->nr_migrations;
+	rec.deadline = proc->dl_deadline;
+
+	/* Another exit may move the array, the copy is made under the lock */
 	pthread_mutex_lock(&queue_lock);
-	enqueue(&running_list, proc);
-	pthread_mutex_unlock(&queue_lock);	
+	sched_forget(proc);
+	rec.dl_admitted = proc->dl_admitted;
+	if (proc->dl_admitted)
+		dl_release(proc);
+	if (sched_nrecords == sched_records_cap) {
+		sched_records_cap = sched_records_cap ? 2 * sched_records_cap : 16;
+		sched_records = realloc(sched_records,
+			sched_records_cap * sizeof(struct sched_record));
+	}
+	sched_records[sched_nrecords++] = rec;
+	pthread_mutex_unlock(&queue_lock);
+}
+
+static int cmp_u64(const void * a, const void * b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+static int cmp_u32(const void * a, const void * b) {
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of n sorted values */
+static uint32_t percentile(uint32_t * v, int n, int pct) {
+	int rank = (pct * n + 99) / 100;
+	return v[rank > 0 ? rank - 1 : 0];
 }
+
+static void print_wait_percentiles(void) {
+	int prio, n;
+	uint32_t * v;
+
+	printf("wait per base priority (slots):\n");
+	for (prio = 0; prio < MAX_PRIO; prio++) {
+		n = sched_waits[prio].n;
+		v = sched_waits[prio].v;
+		if (n == 0)
+			continue;
+		qsort(v, n, sizeof(uint32_t), cmp_u32);
+		printf("  prio %3d: %4d waits, p50 %u, p90 %u, p99 %u, max %u\n",
+			prio, n, percentile(v, n, 50), percentile(v, n, 90),
+			percentile(v, n, 99), v[n - 1]);
+	}
+#ifdef MLQ_SCHED
+	if (mlq_age_slots > 0)
+		printf("aging: %lu levels gained waiting, %lu lost to full time slices\n",
+			mlq_promotions, mlq_demotions);
+	if (mlq_spills > 0)
+		printf("%lu process(es) queued at another level, theirs full\n",
+			mlq_spills);
 #endif
+}
+
+static void print_deadline_stat(void) {
+	struct sched_record * rec;
+	int i, nr_requested = 0, nr_missed = 0;
+
+	for (i = 0; i < sched_nrecords; i++) {
+		rec = &sched_records[i];
+		if (rec->deadline == 0)
+			continue;
+		nr_requested++;
+		if (rec->turnaround > rec->deadline)
+			nr_missed++;
+	}
+	if (nr_requested == 0)
+		return;
+
+	printf("deadline class: %d requested, %lu rejected, %lu over budget, %d missed\n",
+		nr_requested, dl_nr_rejected, dl_nr_overrun, nr_missed);
+	for (i = 0; i < sched_nrecords; i++) {
+		rec = &sched_records[i];
+		if (rec->deadline == 0)
+			continue;
+		printf("  pid %3u: deadline %4u, done after %4lu, %s%s\n",
+			rec->pid, rec->deadline, (unsigned long)rec->turnaround,
+			rec->dl_admitted ? "in class" : "out of class",
+			rec->turnaround > rec->deadline ? ", MISSED" : "");
+	}
+}
+
+void print_sched_stat(void) {
+	uint64_t * turnaround;
+	double sum_ta = 0, sum_wait = 0, sum_share = 0, sum_share2 = 0, share;
+	uint64_t sum_run = 0, sum_blocked = 0, end = 0;
+	unsigned long nr_migrations = 0;
+	int i, n = sched_nrecords;
+
+	if (n == 0)
+		return;
+
+	printf("===== SCHEDULING STATISTICS (%s) =====\n",
+		sched_policy == SCHED_POLICY_CFS ? "CFS" : "MLQ");
+	printf("  PID PRIO WEIGHT ARRIVAL TURNAROUND RESPONSE  WAIT   RUN BLOCKED DISPATCH MIGRATE\n");
+	turnaround = malloc(n * sizeof(uint64_t));
+	for (i = 0; i < n; i++) {
+		struct sched_record * rec = &sched_records[i];
+
+		printf("%5u %4u %6u %7lu %10lu %8lu %5lu %5lu %7lu %8u %7u\n",
+			rec->pid, rec->prio, rec->weight,
+			(unsigned long)rec->arrival, (unsigned long)rec->turnaround,
+			(unsigned long)rec->response, (unsigned long)rec->wait,
+			(unsigned long)rec->run, (unsigned long)rec->blocked,
+			rec->nr_dispatch, rec->nr_migrations);
+		nr_migrations += rec->nr_migrations;
+		sum_run += rec->run;
+		sum_blocked += rec->blocked;
+		if (rec->arrival + rec->turnaround > end)
+			end = rec->arrival + rec->turnaround;
+
+		turnaround[i] = rec->turnaround;
+		sum_ta += rec->turnaround;
+		sum_wait += rec->wait;
+		/* CPU share while alive, per unit of weight */
+		share = rec->turnaround
+			? (double)rec->run / rec->turnaround / rec->weight : 0;
+		sum_share += share;
+		sum_share2 += share * share;
+	}
+
+	qsort(turnaround, n, sizeof(uint64_t), cmp_u64);
+	printf("turnaround: avg %.2f, p50 %lu, p95 %lu, max %lu; avg wait %.2f\n",
+		sum_ta / n, (unsigned long)turnaround[(n - 1) / 2],
+		(unsigned long)turnaround[(95 * n + 99) / 100 - 1],
+		(unsigned long)turnaround[n - 1], sum_wait / n);
+	printf("migrations: %lu, %d slot(s) lost each\n",
+		nr_migrations, sched_migration_cost);
+	printf("scheduler calls: %lu, quanta cut short: %lu\n",
+		sched_nr_calls, sched_nr_preempt);
+	/* Busy share of the CPU slots until the last process finished */
+	printf("blocked: %lu times, %lu slots; CPU utilization %.1f%%\n",
+		sched_nr_blocks, (unsigned long)sum_blocked,
+		end ? 100.0 * sum_run / ((double)sched_ncpus * end) : 0.0);
+	if (sched_nr_blocked > 0)
+		printf("%d process(es) left blocked, nothing could wake them\n",
+			sched_nr_blocked);
+	/* Jain's index of the weighted shares, 1.0 is perfectly fair */
+	printf("fairness index: %.3f\n",
+		sum_share2 > 0 ? sum_share * sum_share / (n * sum_share2) : 1.0);
+	free(turnaround);
+
+	print_wait_percentiles();
+	print_deadline_stat();
+}
 
 
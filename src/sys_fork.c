@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2025 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* Sierra release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+#include "common.h"
+#include "syscall.h"
+#include "loader.h"
+#include "sched.h"
+#include "libmem.h"
+#include "mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * __sys_fork - duplicate the calling process
+ * The child is a copy of the caller resuming after the syscall
+ * instruction. Its address space shares every frame of the parent
+ * copy-on-write, see dup_mm(). The fork result is stored like a return
+ * value at offset a2 of region a1, when the caller has that region: the
+ * child PID (its low byte) in the parent, 0 in the child. The PID is
+ * also returned in a1, -1 when the child cannot be queued.
+ */
+int __sys_fork(struct pcb_t *caller, struct sc_regs *regs)
+{
+   struct pcb_t *child = malloc(sizeof(struct pcb_t));
+
+   *child = *caller;
+   child->pid = alloc_pid();
+
+   /* Private copies of the code segment and the register file */
+   child->code = malloc(sizeof(struct code_seg_t));
+   child->code->size = caller->code->size;
+   child->code->text = malloc(sizeof(struct inst_t) * caller->code->size);
+   memcpy(child->code->text, caller->code->text,
+          sizeof(struct inst_t) * caller->code->size);
+
+   child->regs = NULL;
+   if (caller->nregs > 0)
+   {
+      child->regs = malloc(sizeof(addr_t) * caller->nregs);
+      memcpy(child->regs, caller->regs, sizeof(addr_t) * caller->nregs);
+   }
+
+   /* The deadline reservation is the parent's own */
+   child->dl_deadline = child->dl_budget = 0;
+
+   child->page_table = malloc(sizeof(struct page_table_t));
+   memcpy(child->page_table, caller->page_table, sizeof(struct page_table_t));
+
+#ifdef MM_PAGING
+   child->mm = malloc(sizeof(struct mm_struct));
+   pthread_mutex_lock(&mmvm_lock);
+   dup_mm(child->mm, caller);
+   pthread_mutex_unlock(&mmvm_lock);
+
+   /* Before the child can run */
+   __write(child, 0, regs->a1, regs->a2, 0);
+#endif
+
+   if (add_proc(child) < 0)
+   {
+      printf("\tProcess %d: fork failed, no room to queue a child\n", caller->pid);
+#ifdef MM_PAGING
+      free_pcb_memph(child);
+#endif
+      free_pcb(child);
+      regs->a1 = -1;
+      return -1;
+   }
+   printf("\tProcess %d forked child %d\n", caller->pid, child->pid);
+
+#ifdef MM_PAGING
+   __write(caller, 0, regs->a1, regs->a2, child->pid);
+#endif
+   regs->a1 = child->pid;
+   return 0;
+}
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2025 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* Sierra release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+#include "common.h"
+#include "syscall.h"
+#include "sched.h"
+#include "futex.h"
+#include "libmem.h"
+#include "mm.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+#define FUTEX_HASH_BITS 6
+#define FUTEX_HASH_SZ BIT(FUTEX_HASH_BITS)
+
+/* Processes waiting on one key */
+struct futex_q
+{
+   struct futex_key key;
+   struct queue_t wq;
+   struct futex_q *next;
+};
+
+/*
+ * The bucket lock is held from reading the value to joining the wait
+ * queue, and by the waker, so a wakeup right after the value changed
+ * always finds the waiter
+ */
+static struct
+{
+   pthread_mutex_t lock;
+   struct futex_q *head;
+} futex_hash[FUTEX_HASH_SZ];
+
+static pthread_once_t futex_once = PTHREAD_ONCE_INIT;
+
+static struct
+{
+   unsigned long waits;
+   unsigned long changed; /* the value was not the expected one */
+   unsigned long woken;
+} futex_stat;
+
+static void futex_init(void)
+{
+   int i;
+
+   for (i = 0; i < FUTEX_HASH_SZ; i++)
+      pthread_mutex_init(&futex_hash[i].lock, NULL);
+}
+
+static int futex_hash_of(struct futex_key *key)
+{
+   unsigned long h = (unsigned long)key->mm ^ key->addr;
+
+   h ^= h >> 17;
+   h *= 0x9e3779b97f4a7c15UL;
+   return (int)(h >> (64 - FUTEX_HASH_BITS)) & (FUTEX_HASH_SZ - 1);
+}
+
+/*
+ * futex_get_key - key and current value of byte a2 of region a1
+ * The page is brought in through pg_getval() like any read.
+ */
+static int futex_get_key(struct pcb_t *caller, struct sc_regs *regs,
+                         struct futex_key *key, BYTE *val)
+{
+   struct vm_rg_struct *rg;
+   unsigned long addr;
+   uint32_t pte;
+   int ret = -1;
+
+   pthread_mutex_lock(&mmvm_lock);
+   rg = get_symrg_byid(caller->mm, regs->a1);
+   if (rg == NULL || rg->rg_start + regs->a2 >= rg->rg_end)
+      goto out;
+
+   addr = rg->rg_start + regs->a2;
+   if (pg_getval(caller->mm, addr, val, caller) != 0)
+      goto out;
+
+   pte = caller->mm->pgd[PAGING_PGN(addr)];
+   if (pte & PAGING_PTE_SHARED_MASK)
+   {
+      key->mm = NULL;
+      key->addr = PAGING_PHYADDR(PAGING_FPN(pte), PAGING_OFFST(addr));
+   }
+   else
+   {
+      key->mm = caller->mm;
+      key->addr = addr;
+   }
+   ret = 0;
+out:
+   pthread_mutex_unlock(&mmvm_lock);
+   return ret;
+}
+
+/* Queue of key in bucket b, added when create is set; call with the
+ * bucket lock held */
+static struct futex_q *futex_q_find(int b, struct futex_key *key, int create)
+{
+   struct futex_q *fq;
+
+   for (fq = futex_hash[b].head; fq != NULL; fq = fq->next)
+      if (fq->key.mm == key->mm && fq->key.addr == key->addr)
+         return fq;
+
+   if (!create)
+      return NULL;
+
+   fq = calloc(1, sizeof(struct futex_q));
+   fq->key = *key;
+   fq->next = futex_hash[b].head;
+   futex_hash[b].head = fq;
+   return fq;
+}
+
+/* Drop the queue of a key nobody waits on, bucket lock held */
+static void futex_q_put(int b, struct futex_q *fq)
+{
+   struct futex_q **link;
+
+   if (!empty(&fq->wq))
+      return;
+
+   for (link = &futex_hash[b].head; *link != fq; link = &(*link)->next)
+      ;
+   *link = fq->next;
+   free(fq);
+}
+
+/*
+ * __sys_futexwait - sleep while byte a2 of region a1 holds the value a3
+ * The process leaves the run queues until a futexwake on the same byte.
+ * A value already changed returns -1 at once.
+ */
+int __sys_futexwait(struct pcb_t *caller, struct sc_regs *regs)
+{
+   struct futex_key key;
+   struct futex_q *fq;
+   BYTE val;
+   int b, ret;
+
+   pthread_once(&futex_once, futex_init);
+
+   /* The key of a byte never changes, a shared frame does not move, but
+    * the value counts only as read again under the bucket lock */
+   if (futex_get_key(caller, regs, &key, &val) < 0)
+      return -1;
+   b = futex_hash_of(&key);
+
+   pthread_mutex_lock(&futex_hash[b].lock);
+   if (futex_get_key(caller, regs, &key, &val) < 0 || val != (BYTE)regs->a3)
+   {
+      pthread_mutex_unlock(&futex_hash[b].lock);
+      __atomic_fetch_add(&futex_stat.changed, 1, __ATOMIC_RELAXED);
+      return -1;
+   }
+
+   fq = futex_q_find(b, &key, 1);
+   ret = sched_wait(&fq->wq, caller);
+   futex_q_put(b, fq);
+   pthread_mutex_unlock(&futex_hash[b].lock);
+
+   if (ret == 0)
+      __atomic_fetch_add(&futex_stat.waits, 1, __ATOMIC_RELAXED);
+   return ret;
+}
+
+/*
+ * __sys_futexwake - wake up to a3 processes waiting on byte a2 of
+ * region a1, all of them for a3 = 0
+ */
+int __sys_futexwake(struct pcb_t *caller, struct sc_regs *regs)
+{
+   struct futex_key key;
+   struct futex_q *fq;
+   BYTE val;
+   int b, nr = 0;
+
+   pthread_once(&futex_once, futex_init);
+
+   if (futex_get_key(caller, regs, &key, &val) < 0)
+      return -1;
+   b = futex_hash_of(&key);
+
+   pthread_mutex_lock(&futex_hash[b].lock);
+   fq = futex_q_find(b, &key, 0);
+   if (fq != NULL)
+   {
+      nr = sched_wake(&fq->wq, regs->a3 ? (int)regs->a3 : MAX_QUEUE_SIZE);
+      futex_q_put(b, fq);
+   }
+   pthread_mutex_unlock(&futex_hash[b].lock);
+
+   __atomic_fetch_add(&futex_stat.woken, nr, __ATOMIC_RELAXED);
+   if (nr > 0)
+      printf("\tProcess %d woke %d process(es) on region %d offset %d\n",
+             caller->pid, nr, regs->a1, regs->a2);
+   return 0;
+}
+
+void print_futex_stat(void)
+{
+   if (futex_stat.waits + futex_stat.changed == 0)
+      return;
+
+   printf("futex: %lu waits, %lu woken, %lu found the value changed\n",
+          futex_stat.waits, futex_stat.woken, futex_stat.changed);
+}
@@ -13,6 +13,7 @@
 #include "stdio.h"
 #include "libmem.h"
 #include "queue.h"
+#include "sched.h"
 #include "string.h"
 #include <stdlib.h>
 
@@ -46,70 +47,11 @@ int __sys_killall(struct pcb_t *caller, struct sc_regs* regs) {
 
     printf("The procname retrieved from memregionid %d is \"%s\"\n", memrg, proc_name);
 
-    //caller->running_list
-    //caller->mlq_ready_queue
-    struct queue_t *my_running_list = caller->running_list;
-#ifdef MLQ_SCHED
-    struct queue_t *my_mlq_ready_queue = caller->mlq_ready_queue;
-#endif
-    struct pcb_t *target = NULL;
-    int killed_count = 0;
-    
-
-    /* TODO Maching and terminating 
-    *       all processes with given
-    *        name in var proc_name
-    */
-    if (my_running_list->size > 0) {
-        int n = my_running_list->size;
-        for (int i = 0; i < n; i++) {
-            target = dequeue(my_running_list);
-            if (target == NULL) continue; // Kiểm tra tránh lỗi NULL
-
-            // Bảo vệ tiến trình hệ thống và chính mình
-            if (target->pid == 0 || target == caller) {
-                enqueue(my_running_list, target);
-                continue;
-            }
-
-            if (strcmp(target->path, my_proc_name) == 0) {
-                printf("\tProcess %d has been killed\n", target->pid);
-                target->pc = target->code->size; // Đánh dấu tiến trình đã hoàn thành
-                killed_count++;                
-            }
-
-            else enqueue(my_running_list, target); // Trả lại tiến trình vào hàng đợi
-        }
-    }
-#ifdef MLQ_SCHED
-    if (my_mlq_ready_queue->size > 0) {
-        for (int q = 0; q < MAX_PRIO; q++) { // Giả sử có nhiều mức ưu tiên
-            struct queue_t *queue = &my_mlq_ready_queue[q];
-            
-            int n = queue->size;
-            for (int i = 0; i < n; i++) {
-                target = dequeue(queue); // Lấy tiến trình từ mảng
-                if (target == NULL) continue;
-
-                // Bảo vệ tiến trình hệ thống và chính mình
-                if (target->pid == 0 || target == caller) {
-                    enqueue(queue, target);
-                    continue;
-                }
-
-                if (strcmp(target->path, my_proc_name) == 0) {
-                    printf("\tProcess %d has been killed\n", target->pid);
-                    target->pc = target->code->size; // Đánh dấu tiến trình đã hoàn thành
-                    libfree(target, memrg);
-                    free(target); // Giải phóng bộ nhớ của tiến trình
-                    killed_count++;
-                }
-                else enqueue(queue, target); // Trả lại tiến trình vào hàng đợi
-            }
-        }
-    }
+    /* The targets may be running on other CPUs, ready or blocked: each
+     * one is torn down like a finished process by the CPU that gets it
+     * next, see sched_kill() */
+    int killed_count = sched_kill(my_proc_name, caller);
 
-#endif
     printf("\tKilled %d processes matching \"%s\"\n", killed_count, my_proc_name);
     libfree(caller, memrg); // Giải phóng vùng nhớ trong regs
     return killed_count; // Trả về số lượng quá trình bị xóa
@@ -18,16 +18,26 @@ int __sys_memmap(struct pcb_t *caller, struct sc_regs* regs)
 {
    int memop = regs->a1;
    BYTE value;
+   unsigned long addr;
+   int ret = 0;
 
    switch (memop) {
    case SYSMEM_MAP_OP:
-            /* Reserved process case*/
+            /* Map the shared memory segment of key a2, address in a3 */
+            ret = shm_attach(caller, regs->a2, &addr);
+            if (ret >= 0)
+            {
+               regs->a3 = addr;
+               ret = 0;
+            }
             break;
    case SYSMEM_INC_OP:
-            inc_vma_limit(caller, regs->a2, regs->a3);
+            ret = inc_vma_limit(caller, regs->a2, regs->a3);
             break;
    case SYSMEM_SWP_OP:
+            pthread_mutex_lock(&mmvm_lock);
             __mm_swap_page(caller, regs->a2, regs->a3);
+            pthread_mutex_unlock(&mmvm_lock);
             break;
    case SYSMEM_IO_READ:
             MEMPHY_read(caller->mram, regs->a2, &value);
@@ -41,7 +51,7 @@ int __sys_memmap(struct pcb_t *caller, struct sc_regs* regs)
             break;
    }
    
-   return 0;
+   return ret;
 }
 
 
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2025 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* Sierra release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+#include "common.h"
+#include "syscall.h"
+#include "sched.h"
+#include "msgq.h"
+#include <stdio.h>
+
+/*
+ * A blocking send or receive that cannot go on sleeps on the wait queue
+ * of the queue and steps back its pc, the syscall runs again once the
+ * other side wakes it. It tries once more after joining the wait queue
+ * so that a wakeup sent in between is not lost. A call that finds the
+ * wait queue full fails with -1 rather than spinning on the CPU.
+ */
+
+/*
+ * __sys_msgget - create the message queue a1 of a2 messages
+ * Getting an existing key is not an error, its depth is kept.
+ */
+int __sys_msgget(struct pcb_t *caller, struct sc_regs *regs)
+{
+   struct msgq *q = msgq_get(regs->a1, regs->a2);
+
+   if (q == NULL)
+      return -1;
+
+   printf("\tProcess %d opened message queue %d of depth %u\n",
+          caller->pid, regs->a1, q->mask + 1);
+   return 0;
+}
+
+/*
+ * __sys_msgsnd - send the message a2 to queue a1
+ * a3 = MSGQ_NOWAIT fails on a full queue instead of blocking.
+ */
+int __sys_msgsnd(struct pcb_t *caller, struct sc_regs *regs)
+{
+   struct msgq *q = msgq_find(regs->a1);
+
+   if (q == NULL)
+      return -1;
+
+   if (msgq_send(q, regs->a2) < 0)
+   {
+      if (regs->a3 & MSGQ_NOWAIT)
+         return -1;
+      if (sched_wait(&q->senders, caller) < 0)
+         return -1;
+      if (msgq_send(q, regs->a2) == 0)
+         sched_wait_cancel(&q->senders, caller);
+      else
+      {
+         caller->pc--;
+         return 0;
+      }
+   }
+
+   sched_wake(&q->receivers, 1);
+   return 0;
+}
+
+/*
+ * __sys_msgrcv - receive a message from queue a1
+ * a2 = MSGQ_NOWAIT fails on an empty queue instead of blocking.
+ */
+int __sys_msgrcv(struct pcb_t *caller, struct sc_regs *regs)
+{
+   struct msgq *q = msgq_find(regs->a1);
+   uint32_t msg;
+
+   if (q == NULL)
+      return -1;
+
+   if (msgq_recv(q, &msg) < 0)
+   {
+      if (regs->a2 & MSGQ_NOWAIT)
+         return -1;
+      if (sched_wait(&q->receivers, caller) < 0)
+         return -1;
+      if (msgq_recv(q, &msg) == 0)
+         sched_wait_cancel(&q->receivers, caller);
+      else
+      {
+         caller->pc--;
+         return 0;
+      }
+   }
+
+   sched_wake(&q->senders, 1);
+   printf("\tProcess %d received %u from message queue %d\n",
+          caller->pid, msg, regs->a1);
+   return 0;
+}
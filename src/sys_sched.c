@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2025 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* Sierra release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+#include "common.h"
+#include "syscall.h"
+#include "sched.h"
+#include <stdio.h>
+
+/*
+ * __sys_setaffinity - restrict process a1 to the CPUs set in mask a2
+ * A pid of 0 names the caller, any other process must be ready. The
+ * mask is cut to the existing CPUs and may not end up empty.
+ */
+int __sys_setaffinity(struct pcb_t *caller, struct sc_regs *regs)
+{
+   uint32_t pid = regs->a1 ? regs->a1 : caller->pid;
+
+   if (sched_set_affinity(caller, regs->a1, regs->a2) < 0)
+      return -1;
+
+   printf("\tProcess %d set the CPU affinity of %d to %#x\n",
+          caller->pid, pid, regs->a2);
+   return 0;
+}
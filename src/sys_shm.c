@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2025 pdnguyen of HCMC University of Technology VNU-HCM
+ */
+
+/* Sierra release
+ * Source Code License Grant: The authors hereby grant to Licensee
+ * personal permission to use and modify the Licensed Source Code
+ * for the sole purpose of studying while attending the course CO2018.
+ */
+
+#include "common.h"
+#include "syscall.h"
+#include "libmem.h"
+#include "mm.h"
+#include <stdio.h>
+
+/*
+ * __sys_shmget - create the shared memory segment a1 of a2 bytes
+ * Getting an existing key is not an error, its size is kept.
+ */
+int __sys_shmget(struct pcb_t *caller, struct sc_regs *regs)
+{
+   int ret;
+
+   pthread_mutex_lock(&mmvm_lock);
+   ret = shm_get(caller, regs->a1, regs->a2);
+   pthread_mutex_unlock(&mmvm_lock);
+
+   return ret;
+}
+
+/*
+ * __sys_shmat - attach the shared memory segment a1 as memory region a2
+ * The region is then read and written like any allocated region, freeing
+ * it detaches the segment.
+ */
+int __sys_shmat(struct pcb_t *caller, struct sc_regs *regs)
+{
+   struct vm_rg_struct *rg;
+   unsigned long addr;
+   int size;
+
+   pthread_mutex_lock(&mmvm_lock);
+   rg = get_symrg_slot(caller->mm, regs->a2);
+   if (rg == NULL || rg->rg_start < rg->rg_end)
+   {
+      pthread_mutex_unlock(&mmvm_lock);
+      return -1; /* Invalid or live region */
+   }
+
+   size = shm_attach(caller, regs->a1, &addr);
+   if (size < 0)
+   {
+      pthread_mutex_unlock(&mmvm_lock);
+      return -1;
+   }
+
+   rg->rg_start = addr;
+   rg->rg_end = addr + size;
+   pthread_mutex_unlock(&mmvm_lock);
+
+   printf("\tProcess %d attached shared memory %d at %08lx\n",
+          caller->pid, regs->a1, addr);
+   return 0;
+}